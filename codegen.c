@@ -0,0 +1,1020 @@
+#include "codegen.h"
+#include "tokenizer.h"
+#include "iom.h"
+
+// RV32 registers
+#define REG_ZERO 0
+#define REG_RA 1
+#define REG_SP 2
+#define REG_T0 5
+#define REG_T1 6
+#define REG_S0 8
+#define REG_S1 9
+#define REG_A0 10
+#define REG_A1 11
+#define REG_S2 18
+#define REG_T6 31
+
+// Frame: ra, s0, s1, s2, the FOR stack top as a byte offset and the FOR
+// stack, which holds variable, limit and loop address like for_statement
+#define CODEGEN_FOR_TOP 16
+#define CODEGEN_FOR_ENTRY 12
+#define CODEGEN_FOR_VAR 20
+#define CODEGEN_FOR_LIMIT 24
+#define CODEGEN_FOR_LOOP 28
+#define CODEGEN_FRAME_SIZE ((CODEGEN_FOR_VAR + CODEGEN_FOR_ENTRY * UBASIC_MAX_FOR_STACK_DEPTH + 15) & ~15)
+
+// GOSUB pushes its return address in a 16 byte block to keep sp aligned
+#define CODEGEN_GOSUB_FRAME 16
+
+#define CODEGEN_CODE_WORDS (UBASIC_NATIVE_CODE_SIZE / 4)
+#define CODEGEN_FIXUPS_PER_LINE 2
+#define CODEGEN_EPILOGUE -1
+
+// Hot line entries are stored as word offset + 1, zero is a cold line
+#define CODEGEN_LINE_REJECTED -1
+
+static const uint8_t temp_regs[] = {5, 6, 7, 28, 29, 30, 12, 13, 14, 15};
+
+struct fixup
+{
+    int16_t at;
+    int16_t line;
+};
+
+struct codegen
+{
+    uint32_t code[CODEGEN_CODE_WORDS];
+    // Per line tables, carved by the interperter from the program area
+    struct fixup *fixups;
+    int16_t *line_start;
+    int16_t *line_entry;
+    uint8_t *line_hits;
+    int max_lines;
+    struct line_index *lines;
+    struct codegen_env const *env;
+    int count;
+    int pc;
+    int fixup_count;
+    int if_depth;
+    int reg_top;
+    int failed;
+    int valid;
+    int line_mode;
+    int fresh; // Code written since the last fence.i
+};
+
+static struct codegen self;
+
+static int compile_expr(void);
+static void compile_port(int rd, int output);
+
+static void emit(uint32_t insn)
+{
+    if (self.pc >= CODEGEN_CODE_WORDS)
+    {
+        self.failed = 1;
+        return;
+    }
+
+    self.code[self.pc++] = insn;
+}
+
+static uint32_t r_type(int funct7, int rs2, int rs1, int funct3, int rd)
+{
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | 0x33;
+}
+
+static uint32_t i_type(int32_t imm, int rs1, int funct3, int rd, int opcode)
+{
+    return ((uint32_t)imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t s_type(int32_t imm, int rs2, int rs1, int funct3)
+{
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 5) & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | (u & 0x1f) << 7 | 0x23;
+}
+
+static uint32_t b_type(int32_t offset, int rs2, int rs1, int funct3)
+{
+    uint32_t u = (uint32_t)offset;
+    return ((u >> 12) & 1) << 31 | ((u >> 5) & 0x3f) << 25 | rs2 << 20 | rs1 << 15 |
+           funct3 << 12 | ((u >> 1) & 0xf) << 8 | ((u >> 11) & 1) << 7 | 0x63;
+}
+
+static uint32_t j_type(int32_t offset, int rd)
+{
+    uint32_t u = (uint32_t)offset;
+    return ((u >> 20) & 1) << 31 | ((u >> 1) & 0x3ff) << 21 | ((u >> 11) & 1) << 20 |
+           ((u >> 12) & 0xff) << 12 | rd << 7 | 0x6f;
+}
+
+#define ADDI(rd, rs1, imm) i_type(imm, rs1, 0, rd, 0x13)
+#define XORI(rd, rs1, imm) i_type(imm, rs1, 4, rd, 0x13)
+#define SLTIU(rd, rs1, imm) i_type(imm, rs1, 3, rd, 0x13)
+#define SRAI(rd, rs1, sh) i_type(0x400 | (sh), rs1, 5, rd, 0x13)
+#define LW(rd, rs1, imm) i_type(imm, rs1, 2, rd, 0x03)
+#define LBU(rd, rs1, imm) i_type(imm, rs1, 4, rd, 0x03)
+#define JALR(rd, rs1, imm) i_type(imm, rs1, 0, rd, 0x67)
+#define SW(rs2, rs1, imm) s_type(imm, rs2, rs1, 2)
+#define SB(rs2, rs1, imm) s_type(imm, rs2, rs1, 0)
+#define BEQ(rs1, rs2, off) b_type(off, rs2, rs1, 0)
+#define BNE(rs1, rs2, off) b_type(off, rs2, rs1, 1)
+#define BLT(rs1, rs2, off) b_type(off, rs2, rs1, 4)
+#define BGE(rs1, rs2, off) b_type(off, rs2, rs1, 5)
+#define JAL(rd, off) j_type(off, rd)
+#define AUIPC(rd, imm) (((uint32_t)(imm) & 0xfffff000) | (rd) << 7 | 0x17)
+#define LUI(rd, imm) (((uint32_t)(imm) & 0xfffff000) | (rd) << 7 | 0x37)
+
+#define ADD(rd, rs1, rs2) r_type(0x00, rs2, rs1, 0, rd)
+#define SUB(rd, rs1, rs2) r_type(0x20, rs2, rs1, 0, rd)
+#define SLL(rd, rs1, rs2) r_type(0x00, rs2, rs1, 1, rd)
+#define SLT(rd, rs1, rs2) r_type(0x00, rs2, rs1, 2, rd)
+#define SLTU(rd, rs1, rs2) r_type(0x00, rs2, rs1, 3, rd)
+#define XOR(rd, rs1, rs2) r_type(0x00, rs2, rs1, 4, rd)
+#define SRA(rd, rs1, rs2) r_type(0x20, rs2, rs1, 5, rd)
+#define OR(rd, rs1, rs2) r_type(0x00, rs2, rs1, 6, rd)
+#define AND(rd, rs1, rs2) r_type(0x00, rs2, rs1, 7, rd)
+#define MUL(rd, rs1, rs2) r_type(0x01, rs2, rs1, 0, rd)
+#define DIV(rd, rs1, rs2) r_type(0x01, rs2, rs1, 4, rd)
+#define REM(rd, rs1, rs2) r_type(0x01, rs2, rs1, 6, rd)
+
+static void emit_li(int rd, int32_t imm)
+{
+    int32_t lo = (int32_t)((uint32_t)imm << 20) >> 20;
+    uint32_t hi = (uint32_t)imm - (uint32_t)lo;
+
+    if (hi == 0)
+    {
+        emit(ADDI(rd, REG_ZERO, lo));
+        return;
+    }
+
+    emit(LUI(rd, hi));
+
+    if (lo != 0)
+    {
+        emit(ADDI(rd, rd, lo));
+    }
+}
+
+static void emit_call(void const *fn)
+{
+    emit_li(REG_T6, (int32_t)(uintptr_t)fn);
+    emit(JALR(REG_RA, REG_T6, 0));
+}
+
+static void emit_jump(int line)
+{
+    if (self.fixup_count >= CODEGEN_FIXUPS_PER_LINE * self.max_lines)
+    {
+        self.failed = 1;
+        return;
+    }
+
+    // A single line hands the next slot back to run_statement instead
+    if (self.line_mode)
+    {
+        emit(ADDI(REG_A0, REG_ZERO, line == CODEGEN_EPILOGUE ? CODEGEN_LINE_END : line));
+        line = CODEGEN_EPILOGUE;
+    }
+
+    self.fixups[self.fixup_count].at = self.pc;
+    self.fixups[self.fixup_count].line = line;
+    self.fixup_count++;
+    emit(JAL(REG_ZERO, 0));
+}
+
+static int reg_push(void)
+{
+    if (self.reg_top >= (int)sizeof(temp_regs))
+    {
+        self.failed = 1;
+        return temp_regs[0];
+    }
+
+    return temp_regs[self.reg_top++];
+}
+
+static void reg_pop(void)
+{
+    if (self.reg_top > 0)
+    {
+        self.reg_top--;
+    }
+}
+
+static void expect(int token)
+{
+    if (tokenizer_token() != token)
+    {
+        self.failed = 1;
+        return;
+    }
+
+    tokenizer_next();
+}
+
+static int expect_variable(void)
+{
+    int var = tokenizer_variable_num();
+    expect(TOKENIZER_VARIABLE);
+    return var;
+}
+
+// Same lookup as index_find, the jump lands on the slot the interpreter would pick
+static int find_line(int linenum)
+{
+    for (int i = 0; i < self.count; ++i)
+    {
+        if (self.lines[i].line_number == linenum)
+        {
+            if (self.lines[i].idx < 0 || self.lines[i].idx >= self.count)
+            {
+                break;
+            }
+
+            return self.lines[i].idx;
+        }
+    }
+
+    self.failed = 1;
+    return 0;
+}
+
+static int compile_factor(void)
+{
+    int r, t, op;
+
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_NUMBER:
+        r = reg_push();
+        emit_li(r, tokenizer_value());
+        tokenizer_next();
+        break;
+    case TOKENIZER_LEFTPAREN:
+        tokenizer_next();
+        r = compile_expr();
+        expect(TOKENIZER_RIGHTPAREN);
+        break;
+    case TOKENIZER_MINUS:
+        tokenizer_next();
+        r = compile_factor();
+        emit(SUB(r, REG_ZERO, r));
+        break;
+    case TOKENIZER_NOT:
+        tokenizer_next();
+        r = compile_factor();
+        emit(XORI(r, r, -1));
+        break;
+    case TOKENIZER_ABS:
+        tokenizer_next();
+        r = compile_factor();
+        t = reg_push();
+        emit(SRAI(t, r, 31));
+        emit(XOR(r, r, t));
+        emit(SUB(r, r, t));
+        reg_pop();
+        break;
+    case TOKENIZER_MIN:
+    case TOKENIZER_MAX:
+        op = tokenizer_token();
+        tokenizer_next();
+        expect(TOKENIZER_LEFTPAREN);
+        r = compile_expr();
+        expect(TOKENIZER_COMMA);
+        t = compile_expr();
+        expect(TOKENIZER_RIGHTPAREN);
+        emit(op == TOKENIZER_MIN ? BLT(r, t, 8) : BLT(t, r, 8));
+        emit(ADDI(r, t, 0));
+        reg_pop();
+        break;
+    case TOKENIZER_VARIABLE:
+        r = reg_push();
+        emit(LW(r, REG_S1, 4 * expect_variable()));
+        break;
+    case TOKENIZER_IN:
+        tokenizer_next();
+        expect(TOKENIZER_LEFTPAREN);
+        r = reg_push();
+        compile_port(r, 0);
+        emit(LBU(r, r, 0));
+        expect(TOKENIZER_RIGHTPAREN);
+        break;
+    case TOKENIZER_TIMER:
+        tokenizer_next();
+        r = reg_push();
+        emit_li(r, IO_ADDR(TVR));
+        emit(LBU(r, r, 0));
+        break;
+    default:
+        // FN, strings and anything unknown stay with the interpreter
+        self.failed = 1;
+        r = reg_push();
+        break;
+    }
+
+    return r;
+}
+
+static int compile_term(void)
+{
+    int r1 = compile_factor();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_ASTR ||
+           op == TOKENIZER_SLASH ||
+           op == TOKENIZER_MOD ||
+           op == TOKENIZER_SHL ||
+           op == TOKENIZER_SHR)
+    {
+        tokenizer_next();
+        int r2 = compile_factor();
+
+        switch (op)
+        {
+        case TOKENIZER_ASTR:
+            emit(MUL(r1, r1, r2));
+            break;
+        case TOKENIZER_SLASH:
+            emit(DIV(r1, r1, r2));
+            break;
+        case TOKENIZER_MOD:
+            emit(REM(r1, r1, r2));
+            break;
+        case TOKENIZER_SHL:
+            emit(SLL(r1, r1, r2));
+            break;
+        case TOKENIZER_SHR:
+            emit(SRA(r1, r1, r2));
+            break;
+        }
+
+        reg_pop();
+        op = tokenizer_token();
+    }
+
+    return r1;
+}
+
+static int compile_expr(void)
+{
+    int r1 = compile_term();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_PLUS ||
+           op == TOKENIZER_MINUS ||
+           op == TOKENIZER_AND ||
+           op == TOKENIZER_OR ||
+           op == TOKENIZER_XOR)
+    {
+        tokenizer_next();
+        int r2 = compile_term();
+
+        switch (op)
+        {
+        case TOKENIZER_PLUS:
+            emit(ADD(r1, r1, r2));
+            break;
+        case TOKENIZER_MINUS:
+            emit(SUB(r1, r1, r2));
+            break;
+        case TOKENIZER_AND:
+            emit(AND(r1, r1, r2));
+            break;
+        case TOKENIZER_OR:
+            emit(OR(r1, r1, r2));
+            break;
+        case TOKENIZER_XOR:
+            emit(XOR(r1, r1, r2));
+            break;
+        }
+
+        reg_pop();
+        op = tokenizer_token();
+    }
+
+    return r1;
+}
+
+static int compile_relation(void)
+{
+    int r1 = compile_expr();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_LT ||
+           op == TOKENIZER_GT ||
+           op == TOKENIZER_EQ ||
+           op == TOKENIZER_LE ||
+           op == TOKENIZER_GE ||
+           op == TOKENIZER_NE)
+    {
+        tokenizer_next();
+        int r2 = compile_expr();
+
+        switch (op)
+        {
+        case TOKENIZER_LT:
+            emit(SLT(r1, r1, r2));
+            break;
+        case TOKENIZER_GT:
+            emit(SLT(r1, r2, r1));
+            break;
+        case TOKENIZER_EQ:
+            emit(SUB(r1, r1, r2));
+            emit(SLTIU(r1, r1, 1));
+            break;
+        case TOKENIZER_LE:
+            emit(SLT(r1, r2, r1));
+            emit(XORI(r1, r1, 1));
+            break;
+        case TOKENIZER_GE:
+            emit(SLT(r1, r1, r2));
+            emit(XORI(r1, r1, 1));
+            break;
+        case TOKENIZER_NE:
+            emit(SUB(r1, r1, r2));
+            emit(SLTU(r1, REG_ZERO, r1));
+            break;
+        }
+
+        reg_pop();
+        op = tokenizer_token();
+    }
+
+    return r1;
+}
+
+static void compile_print(void)
+{
+    int r;
+
+    tokenizer_next();
+
+    do
+    {
+        switch (tokenizer_token())
+        {
+        case TOKENIZER_STRING:
+        {
+            // The literal stays in the program store, which outlives the code
+            int len;
+            char const *text = tokenizer_literal(&len);
+
+            emit_li(REG_A0, (int32_t)(uintptr_t)text);
+            emit_li(REG_A1, len);
+            emit_call(self.env->write);
+            tokenizer_next();
+            break;
+        }
+        case TOKENIZER_COMMA:
+            emit_li(REG_A0, ' ');
+            emit_call(self.env->write_char);
+            tokenizer_next();
+            break;
+        case TOKENIZER_SEMICOLON:
+            tokenizer_next();
+            break;
+        default:
+            r = compile_expr();
+            emit(ADDI(REG_A0, r, 0));
+            reg_pop();
+            emit_call(self.env->print_number);
+            break;
+        }
+    } while (!self.failed &&
+             tokenizer_token() != TOKENIZER_CR &&
+             tokenizer_token() != TOKENIZER_ENDOFINPUT);
+
+    emit_li(REG_A0, '\n');
+    emit_call(self.env->write_char);
+}
+
+static void compile_statement(void);
+
+static void compile_if(void)
+{
+    int r, at;
+
+    tokenizer_next();
+    r = compile_relation();
+    reg_pop();
+    expect(TOKENIZER_THEN);
+
+    at = self.pc;
+    emit(0);
+
+    if (tokenizer_token() == TOKENIZER_GOTO)
+    {
+        tokenizer_next();
+        emit_jump(find_line(tokenizer_num()));
+    }
+    else
+    {
+        self.if_depth++;
+        compile_statement();
+        self.if_depth--;
+    }
+
+    if (!self.failed)
+    {
+        self.code[at] = BEQ(r, REG_ZERO, (self.pc - at) * 4);
+    }
+}
+
+static void compile_gosub(void)
+{
+    int target;
+
+    tokenizer_next();
+    target = find_line(tokenizer_num());
+    expect(TOKENIZER_NUMBER);
+
+    // A full stack falls through like gosub_statement does
+    emit_li(REG_T0, UBASIC_MAX_GOSUB_STACK_DEPTH);
+    emit(BGE(REG_S2, REG_T0, 28));
+    emit(ADDI(REG_S2, REG_S2, 1));
+    emit(ADDI(REG_SP, REG_SP, -CODEGEN_GOSUB_FRAME));
+    emit(AUIPC(REG_T0, 0));
+    emit(ADDI(REG_T0, REG_T0, 16));
+    emit(SW(REG_T0, REG_SP, 0));
+    emit_jump(target);
+}
+
+static void compile_return(void)
+{
+    tokenizer_next();
+
+    emit(BEQ(REG_S2, REG_ZERO, 20));
+    emit(ADDI(REG_S2, REG_S2, -1));
+    emit(LW(REG_T0, REG_SP, 0));
+    emit(ADDI(REG_SP, REG_SP, CODEGEN_GOSUB_FRAME));
+    emit(JALR(REG_ZERO, REG_T0, 0));
+}
+
+static void compile_for(void)
+{
+    int var, r;
+
+    tokenizer_next();
+    var = expect_variable();
+    expect(TOKENIZER_EQ);
+
+    r = compile_expr();
+    emit(SW(r, REG_S1, 4 * var));
+    reg_pop();
+    expect(TOKENIZER_TO);
+
+    if (self.if_depth > 0)
+    {
+        self.failed = 1;
+        return;
+    }
+
+    r = compile_expr();
+
+    // A full stack only sets the variable like for_statement does
+    emit(LW(REG_A0, REG_S0, CODEGEN_FOR_TOP));
+    emit(ADDI(REG_A1, REG_ZERO, CODEGEN_FOR_ENTRY * UBASIC_MAX_FOR_STACK_DEPTH));
+    emit(BGE(REG_A0, REG_A1, 40));
+    emit(ADD(REG_A1, REG_S0, REG_A0));
+    emit(SW(r, REG_A1, CODEGEN_FOR_LIMIT));
+    emit(ADDI(REG_T6, REG_ZERO, var));
+    emit(SW(REG_T6, REG_A1, CODEGEN_FOR_VAR));
+    emit(AUIPC(REG_T6, 0));
+    emit(ADDI(REG_T6, REG_T6, 20));
+    emit(SW(REG_T6, REG_A1, CODEGEN_FOR_LOOP));
+    emit(ADDI(REG_A0, REG_A0, CODEGEN_FOR_ENTRY));
+    emit(SW(REG_A0, REG_S0, CODEGEN_FOR_TOP));
+    reg_pop();
+}
+
+// GOTO can leave or enter a loop, so NEXT looks at the innermost FOR that
+// ran, and falls through unless it is for the same variable
+static void compile_next(void)
+{
+    int var;
+
+    tokenizer_next();
+    var = expect_variable();
+
+    if (self.if_depth > 0)
+    {
+        self.failed = 1;
+        return;
+    }
+
+    emit(LW(REG_A0, REG_S0, CODEGEN_FOR_TOP));
+    emit(BEQ(REG_A0, REG_ZERO, 56));
+    emit(ADD(REG_A1, REG_S0, REG_A0));
+    emit(LW(REG_T6, REG_A1, CODEGEN_FOR_VAR - CODEGEN_FOR_ENTRY));
+    emit(ADDI(REG_T6, REG_T6, -var));
+    emit(BNE(REG_T6, REG_ZERO, 40));
+    emit(LW(REG_T0, REG_S1, 4 * var));
+    emit(ADDI(REG_T0, REG_T0, 1));
+    emit(SW(REG_T0, REG_S1, 4 * var));
+    emit(LW(REG_T1, REG_A1, CODEGEN_FOR_LIMIT - CODEGEN_FOR_ENTRY));
+    emit(BLT(REG_T1, REG_T0, 12));
+    emit(LW(REG_T1, REG_A1, CODEGEN_FOR_LOOP - CODEGEN_FOR_ENTRY));
+    emit(JALR(REG_ZERO, REG_T1, 0));
+    emit(ADDI(REG_A0, REG_A0, -CODEGEN_FOR_ENTRY));
+    emit(SW(REG_A0, REG_S0, CODEGEN_FOR_TOP));
+}
+
+static void compile_peek(void)
+{
+    int r, var;
+
+    tokenizer_next();
+    r = compile_expr();
+    expect(TOKENIZER_COMMA);
+    var = expect_variable();
+
+    emit(ADDI(REG_A0, r, 0));
+    reg_pop();
+    emit_call(self.env->peek);
+    emit(SW(REG_A0, REG_S1, 4 * var));
+}
+
+static void compile_poke(void)
+{
+    int r1, r2;
+
+    tokenizer_next();
+    r1 = compile_expr();
+    expect(TOKENIZER_COMMA);
+    r2 = compile_expr();
+
+    emit(ADDI(REG_A0, r1, 0));
+    emit(ADDI(REG_A1, r2, 0));
+    reg_pop();
+    reg_pop();
+    emit_call(self.env->poke);
+}
+
+// Loads the register address of the port name into rd
+static void compile_port(int rd, int output)
+{
+    int addr = port_address(tokenizer_token(), output);
+
+    if (addr == 0)
+    {
+        self.failed = 1;
+    }
+
+    tokenizer_next();
+    emit_li(rd, addr);
+}
+
+static void compile_out(void)
+{
+    int r1, r2;
+
+    tokenizer_next();
+    r1 = reg_push();
+    compile_port(r1, 1);
+    expect(TOKENIZER_COMMA);
+    r2 = compile_expr();
+
+    emit(SB(r2, r1, 0));
+    reg_pop();
+    reg_pop();
+}
+
+static void compile_let(void)
+{
+    int var, r;
+
+    var = expect_variable();
+    expect(TOKENIZER_EQ);
+    r = compile_expr();
+    emit(SW(r, REG_S1, 4 * var));
+    reg_pop();
+}
+
+// GOSUB, RETURN and FOR/NEXT keep state across lines, a single line leaves them to the interpreter
+static int program_scope(void)
+{
+    if (self.line_mode)
+    {
+        self.failed = 1;
+    }
+
+    return !self.line_mode;
+}
+
+static void compile_statement(void)
+{
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_PRINT:
+        compile_print();
+        break;
+    case TOKENIZER_IF:
+        compile_if();
+        break;
+    case TOKENIZER_GOTO:
+        tokenizer_next();
+        emit_jump(find_line(tokenizer_num()));
+        break;
+    case TOKENIZER_GOSUB:
+        if (program_scope())
+        {
+            compile_gosub();
+        }
+        break;
+    case TOKENIZER_RETURN:
+        if (program_scope())
+        {
+            compile_return();
+        }
+        break;
+    case TOKENIZER_FOR:
+        if (program_scope())
+        {
+            compile_for();
+        }
+        break;
+    case TOKENIZER_NEXT:
+        if (program_scope())
+        {
+            compile_next();
+        }
+        break;
+    case TOKENIZER_PEEK:
+        compile_peek();
+        break;
+    case TOKENIZER_POKE:
+        compile_poke();
+        break;
+    case TOKENIZER_OUT:
+        compile_out();
+        break;
+    case TOKENIZER_LET:
+        tokenizer_next();
+        /* Fall through. */
+    case TOKENIZER_VARIABLE:
+        compile_let();
+        break;
+    case TOKENIZER_STRINGVAR:
+    case TOKENIZER_INPUT:
+    case TOKENIZER_DEF:
+    case TOKENIZER_NEW:
+    case TOKENIZER_RUN:
+    case TOKENIZER_LIST:
+    case TOKENIZER_FRE:
+    case TOKENIZER_COMPILE:
+    case TOKENIZER_TRACE:
+    case TOKENIZER_TIME:
+    case TOKENIZER_STATS:
+    case TOKENIZER_MEM:
+    case TOKENIZER_ON:
+    case TOKENIZER_CHECKPOINT:
+    case TOKENIZER_RESUME:
+        self.failed = 1;
+        break;
+    default:
+        // END and everything interperter_execute does not know stop the program
+        emit_jump(CODEGEN_EPILOGUE);
+        break;
+    }
+}
+
+static void resolve_fixups(int epilogue)
+{
+    for (int i = 0; i < self.fixup_count; ++i)
+    {
+        struct fixup *f = &self.fixups[i];
+        int target = f->line == CODEGEN_EPILOGUE ? epilogue : self.line_start[f->line];
+
+        self.code[f->at] = JAL(REG_ZERO, (target - f->at) * 4);
+    }
+}
+
+static void clear_lines(void)
+{
+    for (int i = 0; i < self.max_lines; ++i)
+    {
+        self.line_entry[i] = 0;
+        self.line_hits[i] = 0;
+    }
+}
+
+// Bytes of per line tables codegen_init expects for every program line
+uint16_t codegen_line_bytes(void)
+{
+    return CODEGEN_FIXUPS_PER_LINE * sizeof(struct fixup) + 2 * sizeof(int16_t) + sizeof(uint8_t);
+}
+
+void codegen_init(void *tables, int max_lines)
+{
+    char *p = tables;
+
+    self.fixups = (struct fixup *)p;
+    p += CODEGEN_FIXUPS_PER_LINE * max_lines * sizeof(struct fixup);
+    self.line_start = (int16_t *)p;
+    p += max_lines * sizeof(int16_t);
+    self.line_entry = (int16_t *)p;
+    p += max_lines * sizeof(int16_t);
+    self.line_hits = (uint8_t *)p;
+    self.max_lines = max_lines;
+    self.valid = 0;
+    self.pc = 0;
+
+    clear_lines();
+}
+
+// Compiles one line into a function returning the next slot, appended after the code in use
+static int compile_line(struct line_index *lines, int count, int slot, struct codegen_env const *env)
+{
+    int start = self.pc;
+    int epilogue;
+
+#if UBASIC_FIXED_POINT
+    // Q16.16 multiply and divide are not generated
+    return CODEGEN_LINE_REJECTED;
+#endif
+
+    self.lines = lines;
+    self.count = count;
+    self.env = env;
+    self.fixup_count = 0;
+    self.if_depth = 0;
+    self.reg_top = 0;
+    self.failed = 0;
+    self.line_mode = 1;
+
+    emit(ADDI(REG_SP, REG_SP, -16));
+    emit(SW(REG_RA, REG_SP, 0));
+    emit(SW(REG_S1, REG_SP, 8));
+    emit_li(REG_S1, (int32_t)(uintptr_t)env->variables);
+
+    tokenizer_init(lines[slot].text);
+    expect(TOKENIZER_NUMBER);
+    compile_statement();
+    emit(ADDI(REG_A0, REG_ZERO, slot + 1));
+
+    epilogue = self.pc;
+
+    emit(LW(REG_RA, REG_SP, 0));
+    emit(LW(REG_S1, REG_SP, 8));
+    emit(ADDI(REG_SP, REG_SP, 16));
+    emit(JALR(REG_ZERO, REG_RA, 0));
+
+    self.line_mode = 0;
+
+    if (self.failed)
+    {
+        self.pc = start;
+        return CODEGEN_LINE_REJECTED;
+    }
+
+    resolve_fixups(epilogue);
+    self.fresh = 1;
+
+    return start + 1;
+}
+
+int codegen_compile(struct line_index *lines, int count, struct codegen_env const *env, int *error_line)
+{
+    int epilogue;
+
+    self.lines = lines;
+    self.count = count;
+    self.env = env;
+    self.pc = 0;
+    self.fixup_count = 0;
+    self.if_depth = 0;
+    self.reg_top = 0;
+    self.failed = 0;
+    self.valid = 0;
+    self.line_mode = 0;
+
+    // The program overwrites any hot lines
+    clear_lines();
+
+    *error_line = -1;
+
+#if UBASIC_FIXED_POINT
+    // Q16.16 multiply and divide are not generated
+    return -1;
+#endif
+
+    emit(ADDI(REG_SP, REG_SP, -CODEGEN_FRAME_SIZE));
+    emit(SW(REG_RA, REG_SP, 0));
+    emit(SW(REG_S0, REG_SP, 4));
+    emit(SW(REG_S1, REG_SP, 8));
+    emit(SW(REG_S2, REG_SP, 12));
+    emit(ADDI(REG_S0, REG_SP, 0));
+    emit_li(REG_S1, (int32_t)(uintptr_t)env->variables);
+    emit(ADDI(REG_S2, REG_ZERO, 0));
+    emit(SW(REG_ZERO, REG_S0, CODEGEN_FOR_TOP));
+
+    for (int i = 0; i < count && !self.failed; ++i)
+    {
+        self.line_start[i] = self.pc;
+
+        if (lines[i].idx == -1)
+        {
+            continue;
+        }
+
+        tokenizer_init(lines[i].text);
+        expect(TOKENIZER_NUMBER);
+        compile_statement();
+
+        if (self.failed)
+        {
+            *error_line = lines[i].line_number;
+        }
+    }
+
+    epilogue = self.pc;
+
+    // END unwinds whatever GOSUB left on the stack
+    emit(ADDI(REG_SP, REG_S0, 0));
+    emit(LW(REG_RA, REG_SP, 0));
+    emit(LW(REG_S1, REG_SP, 8));
+    emit(LW(REG_S2, REG_SP, 12));
+    emit(LW(REG_S0, REG_SP, 4));
+    emit(ADDI(REG_SP, REG_SP, CODEGEN_FRAME_SIZE));
+    emit(JALR(REG_ZERO, REG_RA, 0));
+
+    if (self.failed)
+    {
+        self.pc = 0;
+        return -1;
+    }
+
+    resolve_fixups(epilogue);
+    self.valid = 1;
+    self.fresh = 1;
+
+    return self.pc * 4;
+}
+
+// Calls the code at word, the result is whatever it leaves in a0
+static int run_code(int word, struct codegen_env const *env)
+{
+#if CODEGEN_NATIVE
+    // Instruction fetch does not see the stores that wrote new code until
+    // fence.i, rv32im without Zifencei has no mnemonic for it
+    if (self.fresh)
+    {
+        __asm__ volatile(".word 0x0000100f" ::: "memory");
+        self.fresh = 0;
+    }
+
+    (void)env;
+    return ((int (*)(void))&self.code[word])();
+#elif CODEGEN_RUNS
+    return codegen_emulate(&self.code[word], env);
+#else
+    (void)word;
+    (void)env;
+    return CODEGEN_LINE_INTERPRET;
+#endif
+}
+
+int codegen_execute(void)
+{
+    if (!self.valid || !CODEGEN_RUNS)
+    {
+        return 0;
+    }
+
+    run_code(0, self.env);
+    return 1;
+}
+
+int codegen_line(struct line_index *lines, int count, int slot, struct codegen_env const *env)
+{
+    int entry = self.line_entry[slot];
+
+    if (entry == 0)
+    {
+        if (++self.line_hits[slot] < UBASIC_JIT_THRESHOLD)
+        {
+            return CODEGEN_LINE_INTERPRET;
+        }
+
+        entry = compile_line(lines, count, slot, env);
+        self.line_entry[slot] = entry;
+    }
+
+    if (entry == CODEGEN_LINE_REJECTED)
+    {
+        return CODEGEN_LINE_INTERPRET;
+    }
+
+    return run_code(entry - 1, env);
+}
+
+void codegen_invalidate(void)
+{
+    self.valid = 0;
+    self.pc = 0;
+    clear_lines();
+}
@@ -0,0 +1,45 @@
+#ifndef __CODEGEN_H__
+#define __CODEGEN_H__
+
+#include "interperter.h"
+
+// Generated code only runs on the target, host builds keep interpreting
+// unless CODEGEN_EMULATE hands it to the RV32 emulator in host/rv32.c
+#if defined(__riscv)
+#define CODEGEN_NATIVE 1
+#else
+#define CODEGEN_NATIVE 0
+#endif
+
+#if CODEGEN_NATIVE || defined(CODEGEN_EMULATE)
+#define CODEGEN_RUNS 1
+#else
+#define CODEGEN_RUNS 0
+#endif
+
+// codegen_line results besides the next program_lines slot
+#define CODEGEN_LINE_END -1
+#define CODEGEN_LINE_INTERPRET -2
+
+struct codegen_env
+{
+    VariableType_t *variables;
+    void (*print_number)(VariableType_t);
+    void (*write_char)(char);
+    void (*write)(char *, uint16_t);
+    peek_func peek;
+    poke_func poke;
+};
+
+void codegen_init(void *tables, int max_lines);
+uint16_t codegen_line_bytes(void);
+int codegen_compile(struct line_index *lines, int count, struct codegen_env const *env, int *error_line);
+int codegen_execute(void);
+int codegen_line(struct line_index *lines, int count, int slot, struct codegen_env const *env);
+void codegen_invalidate(void);
+
+#if !CODEGEN_NATIVE && defined(CODEGEN_EMULATE)
+int codegen_emulate(uint32_t const *entry, struct codegen_env const *env);
+#endif
+
+#endif /* __CODEGEN_H__ */
@@ -0,0 +1,727 @@
+// Translates a BASIC program into C that behaves like the interpreter
+//
+//   host/bas2c program.bas > program.c
+//
+// The generated code links against the interpreter for number formatting
+// and routes PEEK/POKE to the simulated I/O map of host/sim.c.
+
+#include "tokenizer.h"
+#include "ubasic_config.h"
+#include "sim.h"
+#include "iom.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINES UBASIC_MAX_PROGRAM_LINES
+
+struct program_line
+{
+    int number;
+    char text[UBASIC_PROGRAM_LINE_WIDTH + 2];
+};
+
+static struct program_line lines[MAX_LINES];
+static int line_count;
+static int current;
+static int depth;
+
+static void fail(char const *what)
+{
+    fprintf(stderr, "bas2c: line %d: %s\n", lines[current].number, what);
+    exit(1);
+}
+
+static char *format(char const *fmt, ...)
+{
+    va_list ap;
+    int len;
+    char *s;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    s = malloc(len + 1);
+
+    if (s == NULL)
+    {
+        fail("out of memory");
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(s, len + 1, fmt, ap);
+    va_end(ap);
+
+    return s;
+}
+
+static char *binary(char const *fmt, char *a, char *b)
+{
+    char *s = format(fmt, a, b);
+
+    free(a);
+    free(b);
+
+    return s;
+}
+
+static char *unary(char const *fmt, char *a)
+{
+    char *s = format(fmt, a);
+
+    free(a);
+
+    return s;
+}
+
+static void indent(void)
+{
+    for (int i = 0; i <= depth; ++i)
+    {
+        fputs("    ", stdout);
+    }
+}
+
+static void expect(int token)
+{
+    if (tokenizer_token() != token)
+    {
+        fail("syntax error");
+    }
+
+    tokenizer_next();
+}
+
+static int expect_variable(void)
+{
+    int var = tokenizer_variable_num();
+
+    expect(TOKENIZER_VARIABLE);
+
+    return var;
+}
+
+static void expect_end(void)
+{
+    if (tokenizer_token() != TOKENIZER_CR && tokenizer_token() != TOKENIZER_ENDOFINPUT)
+    {
+        fail("unexpected text after statement");
+    }
+}
+
+// Slot the interpreter would jump to, program_lines is kept sorted
+static int find_slot(int number)
+{
+    for (int i = 0; i < line_count; ++i)
+    {
+        if (lines[i].number == number)
+        {
+            return i;
+        }
+    }
+
+    fail("jump to a missing line");
+
+    return -1;
+}
+
+// Same port names as port_address in the interperter
+static int port(int output)
+{
+    int addr = 0;
+
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_PA:
+        addr = output ? IO_ADDR(PAO) : IO_ADDR(PAI);
+        break;
+    case TOKENIZER_PB:
+        addr = output ? IO_ADDR(PBO) : IO_ADDR(PBI);
+        break;
+    case TOKENIZER_PC:
+        addr = output ? IO_ADDR(PCO) : IO_ADDR(PCI);
+        break;
+    case TOKENIZER_TIMER:
+        addr = output ? IO_ADDR(TCR) : IO_ADDR(TXP);
+        break;
+    default:
+        fail("unknown port");
+        break;
+    }
+
+    tokenizer_next();
+
+    return addr;
+}
+
+static char *expr(void);
+
+static char *factor(void)
+{
+    char *a, *b;
+    int op;
+
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_NUMBER:
+        a = format("%ld", (long)tokenizer_value());
+        tokenizer_next();
+        return a;
+    case TOKENIZER_VARIABLE:
+        return format("V(%d)", expect_variable());
+    case TOKENIZER_LEFTPAREN:
+        tokenizer_next();
+        a = expr();
+        expect(TOKENIZER_RIGHTPAREN);
+        return a;
+    case TOKENIZER_MINUS:
+        tokenizer_next();
+        return unary("(-%s)", factor());
+    case TOKENIZER_NOT:
+        tokenizer_next();
+        return unary("VARTYPE_FROM_INT(~VARTYPE_TO_INT(%s))", factor());
+    case TOKENIZER_ABS:
+        tokenizer_next();
+        return unary("bas_abs(%s)", factor());
+    case TOKENIZER_MIN:
+    case TOKENIZER_MAX:
+        op = tokenizer_token();
+        tokenizer_next();
+        expect(TOKENIZER_LEFTPAREN);
+        a = expr();
+        expect(TOKENIZER_COMMA);
+        b = expr();
+        expect(TOKENIZER_RIGHTPAREN);
+        return binary(op == TOKENIZER_MIN ? "bas_min(%s, %s)" : "bas_max(%s, %s)", a, b);
+    case TOKENIZER_FN:
+        fail("DEF FN functions are not supported");
+        break;
+    case TOKENIZER_CYCLES:
+    case TOKENIZER_INSTRET:
+        fail("counter functions are not supported");
+        break;
+    case TOKENIZER_IN:
+        tokenizer_next();
+        expect(TOKENIZER_LEFTPAREN);
+        a = format("VARTYPE_FROM_INT(sim_peek(%d) & 0xff)", port(0));
+        expect(TOKENIZER_RIGHTPAREN);
+        return a;
+    case TOKENIZER_TIMER:
+        tokenizer_next();
+        return format("VARTYPE_FROM_INT(sim_peek(%d) & 0xff)", IO_ADDR(TVR));
+    default:
+        fail("string expressions are not supported");
+        break;
+    }
+
+    return NULL;
+}
+
+static char *term(void)
+{
+    char *f1 = factor();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_ASTR ||
+           op == TOKENIZER_SLASH ||
+           op == TOKENIZER_MOD ||
+           op == TOKENIZER_SHL ||
+           op == TOKENIZER_SHR)
+    {
+        tokenizer_next();
+        char *f2 = factor();
+
+        switch (op)
+        {
+        case TOKENIZER_ASTR:
+            f1 = binary("VARTYPE_MUL(%s, %s)", f1, f2);
+            break;
+        case TOKENIZER_SLASH:
+            f1 = binary("VARTYPE_DIV(%s, %s)", f1, f2);
+            break;
+        case TOKENIZER_MOD:
+            f1 = binary("(%s %% %s)", f1, f2);
+            break;
+        case TOKENIZER_SHL:
+            f1 = binary("(%s << (VARTYPE_TO_INT(%s) & 31))", f1, f2);
+            break;
+        case TOKENIZER_SHR:
+            f1 = binary("(%s >> (VARTYPE_TO_INT(%s) & 31))", f1, f2);
+            break;
+        }
+        op = tokenizer_token();
+    }
+
+    return f1;
+}
+
+static char *expr(void)
+{
+    char *t1 = term();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_PLUS ||
+           op == TOKENIZER_MINUS ||
+           op == TOKENIZER_AND ||
+           op == TOKENIZER_OR ||
+           op == TOKENIZER_XOR)
+    {
+        tokenizer_next();
+        char *t2 = term();
+
+        switch (op)
+        {
+        case TOKENIZER_PLUS:
+            t1 = binary("(%s + %s)", t1, t2);
+            break;
+        case TOKENIZER_MINUS:
+            t1 = binary("(%s - %s)", t1, t2);
+            break;
+        case TOKENIZER_AND:
+            t1 = binary("(%s & %s)", t1, t2);
+            break;
+        case TOKENIZER_OR:
+            t1 = binary("(%s | %s)", t1, t2);
+            break;
+        case TOKENIZER_XOR:
+            t1 = binary("(%s ^ %s)", t1, t2);
+            break;
+        }
+        op = tokenizer_token();
+    }
+
+    return t1;
+}
+
+static char *relation(void)
+{
+    char *r1 = expr();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_LT ||
+           op == TOKENIZER_GT ||
+           op == TOKENIZER_EQ ||
+           op == TOKENIZER_LE ||
+           op == TOKENIZER_GE ||
+           op == TOKENIZER_NE)
+    {
+        tokenizer_next();
+        char *r2 = expr();
+
+        switch (op)
+        {
+        case TOKENIZER_LT:
+            r1 = binary("(%s < %s)", r1, r2);
+            break;
+        case TOKENIZER_GT:
+            r1 = binary("(%s > %s)", r1, r2);
+            break;
+        case TOKENIZER_EQ:
+            r1 = binary("(%s == %s)", r1, r2);
+            break;
+        case TOKENIZER_LE:
+            r1 = binary("(%s <= %s)", r1, r2);
+            break;
+        case TOKENIZER_GE:
+            r1 = binary("(%s >= %s)", r1, r2);
+            break;
+        case TOKENIZER_NE:
+            r1 = binary("(%s != %s)", r1, r2);
+            break;
+        }
+        op = tokenizer_token();
+    }
+
+    return r1;
+}
+
+static void print_literal(void)
+{
+    int len;
+    char const *text = tokenizer_literal(&len);
+
+    indent();
+    fputs("dma_nwrite((char *)\"", stdout);
+
+    for (int i = 0; i < len; ++i)
+    {
+        unsigned char c = text[i];
+
+        if (c == '\\' || c < ' ' || c > '~')
+        {
+            printf("\\%03o", c);
+        }
+        else
+        {
+            putchar(c);
+        }
+    }
+
+    printf("\", %d);\n", len);
+}
+
+static void print_statement(void)
+{
+    char *e;
+
+    tokenizer_next();
+
+    do
+    {
+        switch (tokenizer_token())
+        {
+        case TOKENIZER_STRING:
+            print_literal();
+            tokenizer_next();
+            break;
+        case TOKENIZER_COMMA:
+            indent();
+            puts("put_char(' ');");
+            tokenizer_next();
+            break;
+        case TOKENIZER_SEMICOLON:
+            tokenizer_next();
+            break;
+        default:
+            e = expr();
+            indent();
+            printf("print_number(%s);\n", e);
+            free(e);
+            break;
+        }
+    } while (tokenizer_token() != TOKENIZER_CR &&
+             tokenizer_token() != TOKENIZER_ENDOFINPUT);
+
+    indent();
+    puts("put_char('\\n');");
+}
+
+static void statement(void);
+
+static void if_statement(void)
+{
+    char *r;
+
+    tokenizer_next();
+    r = relation();
+    expect(TOKENIZER_THEN);
+
+    indent();
+    printf("if (%s)\n", r);
+    indent();
+    puts("{");
+    depth++;
+    statement();
+    depth--;
+    indent();
+    puts("}");
+
+    free(r);
+}
+
+static void jump_statement(int gosub)
+{
+    int slot;
+
+    tokenizer_next();
+    slot = find_slot(tokenizer_num());
+    expect(TOKENIZER_NUMBER);
+    expect_end();
+
+    indent();
+
+    if (!gosub)
+    {
+        printf("goto L%d;\n", slot);
+        return;
+    }
+
+    // A full stack falls through like gosub_statement does
+    puts("if (gosub_ptr < UBASIC_MAX_GOSUB_STACK_DEPTH)");
+    indent();
+    puts("{");
+    indent();
+    printf("    gosub_stack[gosub_ptr++] = %d;\n", current + 1);
+    indent();
+    printf("    goto L%d;\n", slot);
+    indent();
+    puts("}");
+}
+
+static void for_statement(void)
+{
+    char *from, *to;
+    int var;
+
+    tokenizer_next();
+    var = expect_variable();
+    expect(TOKENIZER_EQ);
+    from = expr();
+    expect(TOKENIZER_TO);
+    to = expr();
+    expect_end();
+
+    indent();
+    printf("V(%d) = %s;\n", var, from);
+    indent();
+    printf("to = %s;\n", to);
+    indent();
+    puts("if (for_ptr < UBASIC_MAX_FOR_STACK_DEPTH)");
+    indent();
+    puts("{");
+    indent();
+    printf("    for_stack[for_ptr].line_after_for = %d;\n", current + 1);
+    indent();
+    printf("    for_stack[for_ptr].for_variable = %d;\n", var);
+    indent();
+    puts("    for_stack[for_ptr++].to = to;");
+    indent();
+    puts("}");
+
+    free(from);
+    free(to);
+}
+
+static void next_statement(void)
+{
+    int var;
+
+    tokenizer_next();
+    var = expect_variable();
+    expect_end();
+
+    indent();
+    printf("if (for_ptr > 0 && for_stack[for_ptr - 1].for_variable == %d)\n", var);
+    indent();
+    puts("{");
+    indent();
+    printf("    V(%d) += VARTYPE_FROM_INT(1);\n", var);
+    indent();
+    printf("    if (V(%d) <= for_stack[for_ptr - 1].to)\n", var);
+    indent();
+    puts("    {");
+    indent();
+    puts("        pc = for_stack[for_ptr - 1].line_after_for;");
+    indent();
+    puts("        goto dispatch;");
+    indent();
+    puts("    }");
+    indent();
+    puts("    for_ptr--;");
+    indent();
+    puts("}");
+}
+
+static void statement(void)
+{
+    char *a, *b;
+    int var;
+
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_PRINT:
+        print_statement();
+        break;
+    case TOKENIZER_IF:
+        if_statement();
+        break;
+    case TOKENIZER_GOTO:
+        jump_statement(0);
+        break;
+    case TOKENIZER_GOSUB:
+        jump_statement(1);
+        break;
+    case TOKENIZER_RETURN:
+        tokenizer_next();
+        expect_end();
+        indent();
+        puts("if (gosub_ptr > 0)");
+        indent();
+        puts("{");
+        indent();
+        puts("    pc = gosub_stack[--gosub_ptr];");
+        indent();
+        puts("    goto dispatch;");
+        indent();
+        puts("}");
+        break;
+    case TOKENIZER_FOR:
+        for_statement();
+        break;
+    case TOKENIZER_NEXT:
+        next_statement();
+        break;
+    case TOKENIZER_PEEK:
+        tokenizer_next();
+        a = expr();
+        expect(TOKENIZER_COMMA);
+        var = expect_variable();
+        expect_end();
+        indent();
+        printf("V(%d) = VARTYPE_FROM_INT(sim_peek(VARTYPE_TO_ADDR(%s)));\n", var, a);
+        free(a);
+        break;
+    case TOKENIZER_POKE:
+        tokenizer_next();
+        a = expr();
+        expect(TOKENIZER_COMMA);
+        b = expr();
+        expect_end();
+        indent();
+        printf("sim_poke(VARTYPE_TO_ADDR(%s), VARTYPE_TO_INT(%s));\n", a, b);
+        free(a);
+        free(b);
+        break;
+    case TOKENIZER_OUT:
+        tokenizer_next();
+        var = port(1);
+        expect(TOKENIZER_COMMA);
+        a = expr();
+        expect_end();
+        indent();
+        printf("sim_poke(%d, VARTYPE_TO_INT(%s) & 0xff);\n", var, a);
+        free(a);
+        break;
+    case TOKENIZER_LET:
+        tokenizer_next();
+        /* Fall through. */
+    case TOKENIZER_VARIABLE:
+        var = expect_variable();
+        expect(TOKENIZER_EQ);
+        a = expr();
+        expect_end();
+        indent();
+        printf("V(%d) = %s;\n", var, a);
+        free(a);
+        break;
+    case TOKENIZER_STRINGVAR:
+        fail("string variables are not supported");
+        break;
+    case TOKENIZER_INPUT:
+    case TOKENIZER_DEF:
+    case TOKENIZER_NEW:
+    case TOKENIZER_RUN:
+    case TOKENIZER_LIST:
+    case TOKENIZER_FRE:
+    case TOKENIZER_COMPILE:
+    case TOKENIZER_TRACE:
+    case TOKENIZER_TIME:
+    case TOKENIZER_STATS:
+    case TOKENIZER_MEM:
+    case TOKENIZER_ON:
+    case TOKENIZER_CHECKPOINT:
+    case TOKENIZER_RESUME:
+        fail("statement is not supported");
+        break;
+    default:
+        // END and everything interperter_execute does not know stop the program
+        indent();
+        puts("goto done;");
+        break;
+    }
+}
+
+static void add_line(int linenum, char *text, int len)
+{
+    int i = 0;
+
+    (void)len;
+
+    while (i < line_count && lines[i].number < linenum)
+    {
+        i++;
+    }
+
+    if (i < line_count && lines[i].number == linenum)
+    {
+        line_count--;
+        memmove(&lines[i], &lines[i + 1], (line_count - i) * sizeof(lines[0]));
+    }
+
+    tokenizer_init(text);
+    tokenizer_next();
+
+    if (tokenizer_token() == TOKENIZER_CR)
+    {
+        return;
+    }
+
+    if (line_count == MAX_LINES)
+    {
+        fprintf(stderr, "bas2c: more than %d lines\n", MAX_LINES);
+        exit(1);
+    }
+
+    memmove(&lines[i + 1], &lines[i], (line_count - i) * sizeof(lines[0]));
+    lines[i].number = linenum;
+    strcpy(lines[i].text, text);
+    line_count++;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s program.bas > program.c\n", argv[0]);
+        return 2;
+    }
+
+    if (sim_load(argv[1], add_line) != 0)
+    {
+        return 1;
+    }
+
+    printf("// Generated by bas2c from %s\n\n", argv[1]);
+    puts("#include \"interperter.h\"");
+    puts("#include \"utility.h\"");
+    puts("#include \"sim.h\"\n");
+    puts("#define V(n) variables[n]\n");
+    puts("static VariableType_t variables[MAX_VARNUM];\n");
+    puts("static inline VariableType_t bas_abs(VariableType_t a) { return a < 0 ? -a : a; }");
+    puts("static inline VariableType_t bas_min(VariableType_t a, VariableType_t b) { return a < b ? a : b; }");
+    puts("static inline VariableType_t bas_max(VariableType_t a, VariableType_t b) { return a > b ? a : b; }\n");
+    puts("int main(int argc, char **argv)");
+    puts("{");
+    puts("    struct for_state for_stack[UBASIC_MAX_FOR_STACK_DEPTH];");
+    puts("    int gosub_stack[UBASIC_MAX_GOSUB_STACK_DEPTH];");
+    puts("    int for_ptr = 0;");
+    puts("    int gosub_ptr = 0;");
+    puts("    int pc = 0;");
+    puts("    VariableType_t to;\n");
+    puts("    sim_init(argc, argv);");
+    puts("    goto dispatch;");
+
+    for (current = 0; current < line_count; ++current)
+    {
+        char const *text = lines[current].text;
+
+        printf("\nL%d: // %.*s\n", current, (int)strcspn(text, "\n"), text);
+
+        tokenizer_init(text);
+        expect(TOKENIZER_NUMBER);
+        statement();
+    }
+
+    puts("    goto done;\n");
+    puts("dispatch:");
+    puts("    switch (pc)");
+    puts("    {");
+
+    for (int i = 0; i < line_count; ++i)
+    {
+        printf("    case %d:\n        goto L%d;\n", i, i);
+    }
+
+    puts("    }\n");
+    puts("done:");
+    puts("    (void)to;");
+    puts("    (void)for_stack;");
+    puts("    (void)gosub_stack;");
+    puts("    return 0;");
+    puts("}");
+
+    return 0;
+}
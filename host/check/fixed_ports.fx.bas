@@ -0,0 +1,8 @@
+10 LET A = 2.5
+20 POKE 65528, 65
+30 PEEK 65528, B
+40 POKE 65532, A * 2
+50 OUT PB, 7
+60 LET C = IN(PB)
+70 PRINT A, B, C
+80 END
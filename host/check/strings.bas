@@ -0,0 +1,19 @@
+10 A$="HELLO"
+20 PRINT "X" + A$
+30 PRINT "X";A$,"Y"
+40 B$="ABCDEFGHIJKLMNOPQRSTUVWXYZ01234"
+50 FOR I=1 TO 14
+60 D$=B$+B$
+70 NEXT I
+80 C$=B$+B$+B$
+90 PRINT LEN(C$)
+100 PRINT LEFT$(A$,-1);"|";
+105 PRINT RIGHT$(A$,-2);"|";
+106 PRINT MID$(A$,2,-1);"|";
+110 PRINT MID$(A$,2)
+120 A$="AB"
+130 FOR I=1 TO 9
+140 A$=A$+A$
+150 PRINT LEN(A$)
+160 NEXT I
+170 PRINT "NOT REACHED"
@@ -0,0 +1,8 @@
+10 ON TIMER 5 GOSUB 100
+20 INPUT 1, "K"; K
+30 PRINT "T";T
+40 IF T<2 THEN GOTO 40
+50 PRINT "T";T
+60 END
+100 T=T+1
+110 RETURN
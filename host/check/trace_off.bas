@@ -0,0 +1,5 @@
+10 TRACE ON
+20 A=1
+30 TRACE OFF
+50 C=9
+60 TRACE
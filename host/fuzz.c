@@ -0,0 +1,437 @@
+// Runs random programs through the reference interpreter and the fast
+// paths and reports the first program whose runs differ
+//
+//   host/fuzz [-s<seed>] [-n<count>] [-b<steps>]
+//   host/fuzz program.bas
+//
+// TRACE ON sends every statement through interperter_execute, TRACE OFF
+// lets fused shapes and native lines take over, and a third run COMPILEs
+// the whole program first. The runs start from the same simulated memory
+// in a child process and are compared on their output, the PEEK/POKE
+// trace, the exit status and the final variables. Host builds only run
+// generated code in host/fuzz-rv, which hands it to the RV32 emulator.
+// Generated programs count their lines in Z and END after steps of them,
+// so jumps backwards cannot loop forever.
+
+#include "interperter.h"
+#include "tokenizer.h"
+#include "ubasic_config.h"
+#include "utility.h"
+#include "sim.h"
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_STATEMENTS 24
+#define MAX_LINES (MAX_STATEMENTS * 4)
+#define FUZZ_ADDRESS 4096 // PEEK and POKE stay within 16 bytes from here
+#define FUZZ_TIMEOUT 5    // Seconds before a run counts as hung
+
+struct program
+{
+    int count;
+    int number[MAX_LINES];
+    char text[MAX_LINES][UBASIC_PROGRAM_LINE_WIDTH + 2];
+};
+
+struct run
+{
+    int status;
+    char *output;
+    size_t len;
+};
+
+static struct program program;
+static uint32_t rng;
+static int statements;
+
+static uint32_t next(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+
+    return rng;
+}
+
+static int pick(int n)
+{
+    return next() % n;
+}
+
+static char var(void)
+{
+    return 'A' + pick(6);
+}
+
+static int target(void)
+{
+    return 10 * (pick(statements) + 1);
+}
+
+static void expr(char *buf, int size, int depth)
+{
+    static char const *const ops[] = {"+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>"};
+    char left[40];
+    char right[40];
+
+    if (depth == 0 || pick(3) == 0)
+    {
+        if (pick(2))
+        {
+            snprintf(buf, size, "%c", var());
+        }
+        else
+        {
+            snprintf(buf, size, "%d", pick(100));
+        }
+        return;
+    }
+
+    expr(left, sizeof(left), depth - 1);
+    expr(right, sizeof(right), depth - 1);
+
+    switch (pick(6))
+    {
+    case 0:
+        snprintf(buf, size, "ABS(%s)", left);
+        break;
+    case 1:
+        snprintf(buf, size, "%s(%s,%s)", pick(2) ? "MIN" : "MAX", left, right);
+        break;
+    case 2:
+        snprintf(buf, size, "(%s%s%s)", left, ops[pick(10)], right);
+        break;
+    default:
+        snprintf(buf, size, "%s%s%s", left, ops[pick(10)], right);
+        break;
+    }
+}
+
+static void add(int number, char const *fmt, ...)
+{
+    char *text = program.text[program.count];
+    int len;
+    va_list ap;
+
+    len = snprintf(text, UBASIC_PROGRAM_LINE_WIDTH, "%d ", number);
+
+    va_start(ap, fmt);
+    vsnprintf(text + len, UBASIC_PROGRAM_LINE_WIDTH - len, fmt, ap);
+    va_end(ap);
+
+    strcat(text, "\n");
+    program.number[program.count++] = number;
+}
+
+// One statement per line, biased towards the shapes the fast paths fuse
+static void statement(int number)
+{
+    static char const *const relops[] = {"<", ">", "=", "<=", ">=", "<>"};
+    char e[40];
+    char v = var();
+    int a = FUZZ_ADDRESS + pick(16);
+
+    // Short enough for the longest statement to fit a program line
+    do
+    {
+        expr(e, sizeof(e), 2);
+    } while (strlen(e) > 12);
+
+    switch (pick(14))
+    {
+    case 0:
+    case 1:
+        add(number, "LET %c=%s", v, e);
+        break;
+    case 2:
+        add(number, "LET %c=%c+%d", v, v, pick(10));
+        break;
+    case 3:
+        add(number, "PRINT %s", e);
+        break;
+    case 4:
+        add(number, "IF %s%s%d THEN GOTO %d", e, relops[pick(6)], pick(50), target());
+        break;
+    case 5:
+        add(number, "IF %c%s%d THEN %c=%s", v, relops[pick(6)], pick(50), var(), e);
+        break;
+    case 6:
+        add(number, "GOTO %d", target());
+        break;
+    case 7:
+        add(number, "GOSUB %d", target());
+        break;
+    case 8:
+        add(number, "RETURN");
+        break;
+    case 9:
+        add(number, "FOR %c=%d TO %d", v, pick(5), pick(10));
+        break;
+    case 10:
+        add(number, "NEXT %c", v);
+        break;
+    case 11:
+        add(number, "POKE %d,%s", a, e);
+
+        if (pick(2))
+        {
+            add(number + 1, "POKE %d,0", a);
+        }
+        break;
+    case 12:
+        add(number, "PEEK %d,%c", FUZZ_ADDRESS + pick(16), v);
+        break;
+    default:
+        add(number, "END");
+        break;
+    }
+}
+
+static void generate(uint32_t seed, int steps)
+{
+    rng = seed ? seed : 1;
+    program.count = 0;
+    statements = 4 + pick(MAX_STATEMENTS - 4);
+
+    for (int i = 0; i < statements; ++i)
+    {
+        int number = 10 * (i + 1);
+
+        add(number, "Z=Z+1");
+        add(number + 1, "IF Z>%d THEN END", steps);
+        statement(number + 2);
+    }
+}
+
+static int load(char const *path)
+{
+    FILE *f = fopen(path, "r");
+    char buf[256];
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    program.count = 0;
+
+    while (fgets(buf, sizeof(buf), f) != NULL && program.count < MAX_LINES)
+    {
+        int len = strcspn(buf, "\r\n");
+
+        if (len == 0 || len > UBASIC_PROGRAM_LINE_WIDTH - 1)
+        {
+            continue;
+        }
+
+        memcpy(program.text[program.count], buf, len);
+        strcpy(program.text[program.count] + len, "\n");
+        program.number[program.count++] = atoi(buf);
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+static VariableType_t trace_peek(VariableType_t addr)
+{
+    VariableType_t value = sim_peek(addr);
+
+    dma_wait();
+    fprintf(stdout, "<PEEK %d=%d>", addr, value);
+
+    return value;
+}
+
+static void trace_poke(VariableType_t addr, VariableType_t val)
+{
+    dma_wait();
+    fprintf(stdout, "<POKE %d=%d>", addr, val);
+    sim_poke(addr, val);
+}
+
+static void direct(char const *command)
+{
+    char text[UBASIC_PROGRAM_LINE_WIDTH];
+
+    strcpy(text, command);
+    tokenizer_init(text);
+    interperter_reset();
+    interperter_execute();
+}
+
+// Runs the program in a child so a crash or hang only ends that run
+static void execute(char *argv0, char const *trace, int compile, struct run *run)
+{
+    FILE *out = tmpfile();
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0)
+    {
+        char *args[] = {argv0, NULL};
+        char dump[8];
+        FILE *null = fopen("/dev/null", "w");
+
+        dup2(fileno(null), 1);
+        alarm(FUZZ_TIMEOUT);
+
+        sim_init(1, args);
+        interperter_init(trace_peek, trace_poke);
+
+        for (int i = 0; i < program.count; ++i)
+        {
+            interperter_get_line_num(program.text[i]);
+
+            if (!interperter_indexed_line_empty())
+            {
+                interperter_add_line(program.number[i], program.text[i], strlen(program.text[i]));
+            }
+        }
+
+        // COMPILE reports its size, which the other runs have nothing to match
+        if (compile)
+        {
+            direct("COMPILE\n");
+        }
+
+        dma_wait();
+        fflush(stdout);
+        dup2(fileno(out), 1);
+
+        direct(trace);
+        direct("RUN\n");
+
+        for (int i = 0; i < MAX_VARNUM; ++i)
+        {
+            snprintf(dump, sizeof(dump), "PRINT %c\n", 'A' + i);
+            direct(dump);
+        }
+
+        exit(0);
+    }
+
+    waitpid(pid, &run->status, 0);
+
+    run->len = ftell(out);
+    run->output = malloc(run->len + 1);
+    rewind(out);
+    run->len = fread(run->output, 1, run->len, out);
+    run->output[run->len] = '\0';
+    fclose(out);
+}
+
+static char const *describe(int status)
+{
+    static char text[32];
+
+    if (WIFSIGNALED(status))
+    {
+        snprintf(text, sizeof(text), "signal %d", WTERMSIG(status));
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "exit %d", WEXITSTATUS(status));
+    }
+
+    return text;
+}
+
+static int same(struct run const *a, struct run const *b)
+{
+    return a->status == b->status && a->len == b->len && memcmp(a->output, b->output, a->len) == 0;
+}
+
+// Returns 1 when the reference and the fast paths disagree
+static int compare(char *argv0)
+{
+    struct run reference;
+    struct run fast;
+    struct run compiled;
+    int differ;
+
+    execute(argv0, "TRACE ON\n", 0, &reference);
+    execute(argv0, "TRACE OFF\n", 0, &fast);
+    execute(argv0, "TRACE OFF\n", 1, &compiled);
+
+    // RV32 division by zero does not trap like the host does
+    differ = !same(&reference, &fast) ||
+             (!same(&reference, &compiled) && !(WIFSIGNALED(reference.status) && WTERMSIG(reference.status) == SIGFPE));
+
+    if (differ)
+    {
+        for (int i = 0; i < program.count; ++i)
+        {
+            fputs(program.text[i], stdout);
+        }
+
+        printf("--- reference, %s\n%s\n", describe(reference.status), reference.output);
+        printf("--- fast paths, %s\n%s\n", describe(fast.status), fast.output);
+        printf("--- compiled, %s\n%s\n", describe(compiled.status), compiled.output);
+    }
+
+    free(reference.output);
+    free(fast.output);
+    free(compiled.output);
+
+    return differ;
+}
+
+static char const *option(int argc, char **argv, char const *name)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], name, 2) == 0)
+        {
+            return argv[i] + 2;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    char const *path = sim_program_path(argc, argv);
+    char const *seed = option(argc, argv, "-s");
+    char const *count = option(argc, argv, "-n");
+    char const *budget = option(argc, argv, "-b");
+    uint32_t first = seed ? strtoul(seed, NULL, 0) : 1;
+    int programs = count ? atoi(count) : 1000;
+    int steps = budget ? atoi(budget) : 500;
+
+    if (path != NULL)
+    {
+        if (load(path) != 0)
+        {
+            return 2;
+        }
+
+        return compare(argv[0]);
+    }
+
+    for (int i = 0; i < programs; ++i)
+    {
+        generate(first + i, steps);
+
+        if (compare(argv[0]))
+        {
+            printf("seed %u\n", first + i);
+            return 1;
+        }
+    }
+
+    printf("%d programs agree\n", programs);
+
+    return 0;
+}
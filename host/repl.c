@@ -0,0 +1,190 @@
+// Plays a keystroke script into the line editor and times every line
+//
+//   host/repl [-l<ns>] [-n<count>] [-t<ns>] script.txt > /dev/null
+//
+// The script is typed into ubasic_run key by key, ^H and ^L stand for the
+// backspace (8) and clear (12) keys. -n plays it count times, -t fails
+// when the 99th percentile of the per line latency exceeds ns.
+// Terminal output goes to stdout, the report to stderr.
+
+#include "ubasic.h"
+#include "utility.h"
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_SCRIPT 65536
+
+static char script[MAX_SCRIPT];
+static int script_len;
+
+static uint64_t *latency;
+static int lines;
+static uint64_t keys, total;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int load_script(char const *path)
+{
+    FILE *f = fopen(path, "r");
+    int c;
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    while ((c = fgetc(f)) != EOF && script_len < MAX_SCRIPT)
+    {
+        if (c == '\r')
+        {
+            continue;
+        }
+
+        if (c == '^')
+        {
+            int next = fgetc(f);
+
+            if (next == 'H')
+            {
+                c = 8;
+            }
+            else if (next == 'L')
+            {
+                c = 12;
+            }
+            else
+            {
+                ungetc(next, f);
+            }
+        }
+
+        script[script_len++] = c;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+static int compare(void const *a, void const *b)
+{
+    uint64_t x = *(uint64_t const *)a;
+    uint64_t y = *(uint64_t const *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static char const *option(int argc, char **argv, char const *name)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], name, 2) == 0)
+        {
+            return argv[i] + 2;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    char const *path = sim_program_path(argc, argv);
+    char const *count = option(argc, argv, "-n");
+    char const *limit = option(argc, argv, "-t");
+    int repeat = count ? atoi(count) : 1;
+    uint64_t p99;
+
+    if (path == NULL || repeat < 1)
+    {
+        fprintf(stderr, "usage: %s [-l<ns>] [-n<count>] [-t<ns>] script.txt\n", argv[0]);
+        return 2;
+    }
+
+    if (load_script(path) != 0)
+    {
+        return 1;
+    }
+
+    // Every Enter ends a line, keys left over at the end count as one more
+    latency = malloc(sizeof(*latency) * (script_len + 1) * repeat);
+
+    if (latency == NULL)
+    {
+        return 1;
+    }
+
+    sim_init(argc, argv);
+    ubasic_init();
+
+    for (int r = 0; r < repeat; ++r)
+    {
+        uint64_t line_time = 0;
+
+        sim_keys(script, script_len);
+
+        while (sim_keys_left() > 0)
+        {
+            int left = sim_keys_left();
+            char key = script[script_len - left];
+            uint64_t start = now_ns();
+
+            ubasic_run();
+            dma_wait();
+
+            uint64_t spent = now_ns() - start;
+
+            // INPUT statements take their keys from the script as well
+            keys += left - sim_keys_left();
+            line_time += spent;
+            total += spent;
+
+            if (key == 10)
+            {
+                latency[lines++] = line_time;
+                line_time = 0;
+            }
+        }
+
+        if (line_time)
+        {
+            latency[lines++] = line_time;
+        }
+    }
+
+    if (lines == 0)
+    {
+        return 0;
+    }
+
+    qsort(latency, lines, sizeof(*latency), compare);
+
+    // Nearest rank, the smallest latency at least 99% of the lines stay within
+    p99 = latency[(lines * 99 + 99) / 100 - 1];
+
+    fprintf(stderr, "%d lines, %llu keys in %.3f ms\n", lines, (unsigned long long)keys, total / 1e6);
+    fprintf(stderr, "line latency ns: min %llu median %llu p99 %llu max %llu\n",
+            (unsigned long long)latency[0], (unsigned long long)latency[lines / 2],
+            (unsigned long long)p99, (unsigned long long)latency[lines - 1]);
+    fprintf(stderr, "throughput: %.0f lines/s %.0f keys/s\n", lines * 1e9 / total, keys * 1e9 / total);
+
+    if (limit != NULL && p99 > (uint64_t)atoll(limit))
+    {
+        fprintf(stderr, "p99 latency above %s ns\n", limit);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Runs a BASIC program file through the interpreter on the host
+//
+//   host/ubasic [-p] [-l<ns>] program.bas
+//
+// -p echoes writes to the I/O map as <address=value>
+// -l makes every DMA byte take ns nanoseconds to reach the terminal
+
+#include "interperter.h"
+#include "tokenizer.h"
+#include "sim.h"
+
+#include <stdio.h>
+
+// Same bookkeeping as ubasic_run, a bare line number deletes the line
+static void add_line(int linenum, char *text, int len)
+{
+    interperter_get_line_num(text);
+
+    if (interperter_indexed_line_empty())
+    {
+        interperter_remove_line(linenum);
+    }
+    else
+    {
+        interperter_add_line(linenum, text, len);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char const *path = sim_program_path(argc, argv);
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s [-p] [-l<ns>] program.bas\n", argv[0]);
+        return 2;
+    }
+
+    sim_init(argc, argv);
+    interperter_init(sim_peek, sim_poke);
+
+    if (sim_load(path, add_line) != 0)
+    {
+        return 1;
+    }
+
+    tokenizer_init("RUN\n");
+    interperter_reset();
+    interperter_execute();
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+// RV32IM emulator that runs the generated code in host builds with
+// CODEGEN_EMULATE, see host/fuzz-rv in the Makefile
+//
+// The code uses host addresses as they are, so the program has to be linked
+// with -no-pie to keep them below 4G. Calls to the codegen_env functions run
+// on the host, byte accesses below 64K go to the I/O map through peek and
+// poke like PORT_READ and PORT_WRITE do in host builds.
+
+#include "codegen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RV32_STACK_WORDS 1024
+#define RV32_STEP_LIMIT 100000000 // Instructions before a run counts as hung
+#define RV32_RETURN 0             // ra of the outermost call, never code
+
+#define REG_RA 1
+#define REG_SP 2
+#define REG_A0 10
+#define REG_A1 11
+
+static uint32_t x[32];
+static uint32_t stack[RV32_STACK_WORDS];
+
+static void fault(char const *what, uint32_t pc, uint32_t insn)
+{
+    fprintf(stderr, "rv32: %s at %08x (%08x)\n", what, pc, insn);
+    abort();
+}
+
+static int32_t sext(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+static uint32_t *word(uint32_t addr)
+{
+    return (uint32_t *)(uintptr_t)addr;
+}
+
+static uint32_t load(uint32_t addr, int funct3, struct codegen_env const *env, uint32_t pc)
+{
+    if (addr < 0x10000)
+    {
+        if (funct3 != 4)
+        {
+            fault("I/O access wider than a byte", pc, 0);
+        }
+
+        return env->peek(addr) & 0xff;
+    }
+
+    switch (funct3)
+    {
+    case 0:
+        return sext(*(uint8_t *)(uintptr_t)addr, 8);
+    case 1:
+        return sext(*(uint16_t *)(uintptr_t)addr, 16);
+    case 2:
+        return *word(addr);
+    case 4:
+        return *(uint8_t *)(uintptr_t)addr;
+    case 5:
+        return *(uint16_t *)(uintptr_t)addr;
+    }
+
+    fault("bad load", pc, 0);
+    return 0;
+}
+
+static void store(uint32_t addr, uint32_t value, int funct3, struct codegen_env const *env, uint32_t pc)
+{
+    if (addr < 0x10000)
+    {
+        if (funct3 != 0)
+        {
+            fault("I/O access wider than a byte", pc, 0);
+        }
+
+        env->poke(addr, value & 0xff);
+        return;
+    }
+
+    switch (funct3)
+    {
+    case 0:
+        *(uint8_t *)(uintptr_t)addr = value;
+        return;
+    case 1:
+        *(uint16_t *)(uintptr_t)addr = value;
+        return;
+    case 2:
+        *word(addr) = value;
+        return;
+    }
+
+    fault("bad store", pc, 0);
+}
+
+static uint32_t mul_div(int funct3, uint32_t a, uint32_t b)
+{
+    int32_t sa = a;
+    int32_t sb = b;
+
+    switch (funct3)
+    {
+    case 0:
+        return a * b;
+    case 1:
+        return (uint32_t)(((int64_t)sa * sb) >> 32);
+    case 2:
+        return (uint32_t)(((int64_t)sa * (uint64_t)b) >> 32);
+    case 3:
+        return (uint32_t)(((uint64_t)a * b) >> 32);
+    case 4:
+        return b == 0 ? 0xffffffff : (sa == INT32_MIN && sb == -1) ? a : (uint32_t)(sa / sb);
+    case 5:
+        return b == 0 ? 0xffffffff : a / b;
+    case 6:
+        return b == 0 ? a : (sa == INT32_MIN && sb == -1) ? 0 : (uint32_t)(sa % sb);
+    default:
+        return b == 0 ? a : a % b;
+    }
+}
+
+static uint32_t alu(int funct3, int alt, uint32_t a, uint32_t b)
+{
+    switch (funct3)
+    {
+    case 0:
+        return alt ? a - b : a + b;
+    case 1:
+        return a << (b & 31);
+    case 2:
+        return (int32_t)a < (int32_t)b;
+    case 3:
+        return a < b;
+    case 4:
+        return a ^ b;
+    case 5:
+        return alt ? (uint32_t)((int32_t)a >> (b & 31)) : a >> (b & 31);
+    case 6:
+        return a | b;
+    default:
+        return a & b;
+    }
+}
+
+static int branch(int funct3, uint32_t a, uint32_t b, uint32_t pc)
+{
+    switch (funct3)
+    {
+    case 0:
+        return a == b;
+    case 1:
+        return a != b;
+    case 4:
+        return (int32_t)a < (int32_t)b;
+    case 5:
+        return (int32_t)a >= (int32_t)b;
+    case 6:
+        return a < b;
+    case 7:
+        return a >= b;
+    }
+
+    fault("bad branch", pc, 0);
+    return 0;
+}
+
+// Runs a host function the code called through the environment, 0 when pc is not one
+static int host_call(uint32_t pc, struct codegen_env const *env)
+{
+    if (pc == (uint32_t)(uintptr_t)env->print_number)
+    {
+        env->print_number(x[REG_A0]);
+    }
+    else if (pc == (uint32_t)(uintptr_t)env->write_char)
+    {
+        env->write_char(x[REG_A0]);
+    }
+    else if (pc == (uint32_t)(uintptr_t)env->write)
+    {
+        env->write((char *)(uintptr_t)x[REG_A0], x[REG_A1]);
+    }
+    else if (pc == (uint32_t)(uintptr_t)env->peek)
+    {
+        x[REG_A0] = env->peek(x[REG_A0]);
+    }
+    else if (pc == (uint32_t)(uintptr_t)env->poke)
+    {
+        env->poke(x[REG_A0], x[REG_A1]);
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+int codegen_emulate(uint32_t const *entry, struct codegen_env const *env)
+{
+    uint32_t pc = (uint32_t)(uintptr_t)entry;
+    uint32_t saved[32];
+    long steps = 0;
+
+    // Anything the calling convention says survives a call is checked on return
+    for (int i = 0; i < 32; ++i)
+    {
+        x[i] = 0xdead0000 + i;
+    }
+
+    x[0] = 0;
+    x[REG_RA] = RV32_RETURN;
+    x[REG_SP] = (uint32_t)(uintptr_t)&stack[RV32_STACK_WORDS];
+
+    for (int i = 0; i < 32; ++i)
+    {
+        saved[i] = x[i];
+    }
+
+    while (pc != RV32_RETURN)
+    {
+        if (host_call(pc, env))
+        {
+            pc = x[REG_RA];
+            continue;
+        }
+
+        if (++steps > RV32_STEP_LIMIT)
+        {
+            fault("step limit", pc, 0);
+        }
+
+        uint32_t insn = *word(pc);
+        int rd = (insn >> 7) & 31;
+        int funct3 = (insn >> 12) & 7;
+        uint32_t a = x[(insn >> 15) & 31];
+        uint32_t b = x[(insn >> 20) & 31];
+        int32_t imm = sext(insn >> 20, 12);
+        uint32_t next = pc + 4;
+        uint32_t value = 0;
+        int write = 1;
+
+        switch (insn & 0x7f)
+        {
+        case 0x37: // LUI
+            value = insn & 0xfffff000;
+            break;
+        case 0x17: // AUIPC
+            value = pc + (insn & 0xfffff000);
+            break;
+        case 0x6f: // JAL
+            value = next;
+            next = pc + sext((insn >> 31) << 20 | ((insn >> 12) & 0xff) << 12 |
+                                 ((insn >> 20) & 1) << 11 | ((insn >> 21) & 0x3ff) << 1,
+                             21);
+            break;
+        case 0x67: // JALR
+            value = next;
+            next = (a + imm) & ~1u;
+            break;
+        case 0x63:
+            write = 0;
+            if (branch(funct3, a, b, pc))
+            {
+                next = pc + sext((insn >> 31) << 12 | ((insn >> 7) & 1) << 11 |
+                                     ((insn >> 25) & 0x3f) << 5 | ((insn >> 8) & 0xf) << 1,
+                                 13);
+            }
+            break;
+        case 0x03:
+            value = load(a + imm, funct3, env, pc);
+            break;
+        case 0x23:
+            write = 0;
+            store(a + sext((insn >> 25) << 5 | rd, 12), b, funct3, env, pc);
+            break;
+        case 0x13:
+            if (funct3 == 1 || funct3 == 5)
+            {
+                value = alu(funct3, (insn >> 30) & 1, a, (insn >> 20) & 31);
+            }
+            else
+            {
+                value = alu(funct3, 0, a, imm);
+            }
+            break;
+        case 0x33:
+            if ((insn >> 25) == 1)
+            {
+                value = mul_div(funct3, a, b);
+            }
+            else
+            {
+                value = alu(funct3, (insn >> 30) & 1, a, b);
+            }
+            break;
+        case 0x0f: // FENCE, FENCE.I
+            write = 0;
+            break;
+        default:
+            fault("illegal instruction", pc, insn);
+        }
+
+        if (write && rd != 0)
+        {
+            x[rd] = value;
+        }
+
+        pc = next;
+    }
+
+    // sp, s0-s11
+    for (int i = 2; i < 32; ++i)
+    {
+        if ((i == 2 || i == 8 || i == 9 || (i >= 18 && i <= 27)) && x[i] != saved[i])
+        {
+            fault("callee saved register not restored", pc, i);
+        }
+    }
+
+    return x[REG_A0];
+}
@@ -0,0 +1,474 @@
+#include "sim.h"
+#include "utility.h"
+#include "ubasic_config.h"
+
+#include <ctype.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Word accesses at the top of the map may run past the last byte
+static uint8_t memory[SIM_MEMORY_SIZE + sizeof(VariableType_t)];
+static int echo_ports;
+static uint32_t dma_latency; // Nanoseconds per byte
+static uint64_t timer_expires_at; // Zero while the timer is stopped
+static char const *noinit_path;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// One shot timer of TVR ticks like a TCR write with bit 0 starts it
+static void timer_start(void)
+{
+    timer_expires_at = now_ns() + (uint64_t)memory[IO_ADDR(TVR)] * SIM_TIMER_TICK_NS;
+}
+
+static int timer_expired(void)
+{
+    return timer_expires_at != 0 && now_ns() >= timer_expires_at;
+}
+
+void sim_init(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+        {
+            echo_ports = 1;
+        }
+        else if (strncmp(argv[i], "-l", 2) == 0)
+        {
+            dma_latency = atoi(argv[i] + 2);
+        }
+        else if (strncmp(argv[i], "-c", 2) == 0)
+        {
+            noinit_path = argv[i] + 2;
+        }
+    }
+
+    // The last transfer may still be draining when the program exits
+    atexit(dma_wait);
+
+    // Keys read from stdin stay in the pipe until taken, so key_pending sees them
+    setvbuf(stdin, NULL, _IONBF, 0);
+}
+
+char const *sim_program_path(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            return argv[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Feeds every numbered line the way the line editor would store it,
+// upper case and terminated by a newline
+int sim_load(char const *path, sim_line_func line)
+{
+    char text[UBASIC_PROGRAM_LINE_WIDTH + 2];
+    char buf[256];
+    int lineno = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    while (fgets(buf, sizeof(buf), f) != NULL)
+    {
+        int len = strcspn(buf, "\r\n");
+        char *p = buf;
+
+        lineno++;
+
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+            len--;
+        }
+
+        if (len <= 0)
+        {
+            continue;
+        }
+
+        if (!isdigit((unsigned char)*p))
+        {
+            fprintf(stderr, "%s:%d: missing line number\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+
+        if (len > UBASIC_PROGRAM_LINE_WIDTH - 1)
+        {
+            fprintf(stderr, "%s:%d: longer than %d characters\n", path, lineno, UBASIC_PROGRAM_LINE_WIDTH - 1);
+            fclose(f);
+            return -1;
+        }
+
+        for (int i = 0; i < len; ++i)
+        {
+            text[i] = toupper((unsigned char)p[i]);
+        }
+
+        text[len++] = '\n';
+        text[len] = '\0';
+
+        line(atoi(text), text, len);
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+VariableType_t sim_peek(VariableType_t addr)
+{
+    VariableType_t value;
+
+    addr &= SIM_MEMORY_SIZE - 1;
+
+    // TXP is read from the timer, TCR shares its address for writes
+    if (addr == IO_ADDR(TXP))
+    {
+        return timer_expired();
+    }
+
+    memcpy(&value, &memory[addr], sizeof(value));
+
+    return value;
+}
+
+void sim_poke(VariableType_t addr, VariableType_t val)
+{
+    addr &= SIM_MEMORY_SIZE - 1;
+
+    if (addr == IO_ADDR(TCR))
+    {
+        if (val & 0x01)
+        {
+            timer_start();
+        }
+    }
+    else
+    {
+        memcpy(&memory[addr], &val, sizeof(val));
+    }
+
+    if (echo_ports && addr >= SIM_IO_BASE)
+    {
+        dma_wait();
+        fprintf(stdout, "<%d=%d>", addr, val);
+    }
+}
+
+// Terminal and keyboard on stdio, or keys from a script once sim_keys is called
+
+static char const *script_keys;
+static int script_left;
+
+void sim_keys(char const *keys, int len)
+{
+    script_keys = keys;
+    script_left = len;
+}
+
+int sim_keys_left(void)
+{
+    return script_left;
+}
+
+// Whether a key can be read without blocking, stdin at its end counts as pending
+static int key_pending(void)
+{
+    struct pollfd fd = {0, POLLIN, 0};
+
+    if (script_keys != NULL)
+    {
+        return script_left > 0;
+    }
+
+    return poll(&fd, 1, 1) > 0;
+}
+
+static int next_key(void)
+{
+    if (script_keys == NULL)
+    {
+        return getchar();
+    }
+
+    if (script_left == 0)
+    {
+        return EOF;
+    }
+
+    script_left--;
+
+    return (unsigned char)*script_keys++;
+}
+
+struct io_stats io_stats;
+
+#if UBASIC_DMA_ASYNC
+#define DMA_BUFFER_SIZE 64
+
+static char dma_buffers[2][DMA_BUFFER_SIZE];
+static int dma_next;
+#endif
+
+// A transfer completes dma_latency ns per byte after it starts, the
+// memory is only read then so early reuse of a buffer shows in the output.
+// Without UBASIC_DMA_ASYNC dma_start waits for it like the target CPU does
+static char const *dma_pending;
+static uint16_t dma_pending_len;
+static uint64_t dma_done_at;
+
+void _putchar(char character)
+{
+    io_stats.chars++;
+    dma_wait();
+    fputc(character, stdout);
+}
+
+void dma_wait(void)
+{
+    if (dma_pending == NULL)
+    {
+        return;
+    }
+
+    while (now_ns() < dma_done_at)
+        ;
+
+    fwrite(dma_pending, 1, dma_pending_len, stdout);
+    dma_pending = NULL;
+}
+
+void dma_start(char const *str, uint16_t len)
+{
+    io_stats.dma_bytes += len;
+    dma_wait();
+
+    dma_pending = str;
+    dma_pending_len = len;
+    dma_done_at = now_ns() + (uint64_t)len * dma_latency;
+
+#if !UBASIC_DMA_ASYNC
+    dma_wait();
+#endif
+}
+
+void dma_nwrite(char *str, uint16_t len)
+{
+#if UBASIC_DMA_ASYNC
+    while (len > 0)
+    {
+        uint16_t n = len < DMA_BUFFER_SIZE ? len : DMA_BUFFER_SIZE;
+        char *buf = dma_buffers[dma_next];
+
+        dma_next ^= 1;
+        memcpy(buf, str, n);
+        dma_start(buf, n);
+
+        str += n;
+        len -= n;
+    }
+#else
+    dma_start(str, len);
+#endif
+}
+
+void dma_write(char *str)
+{
+    dma_nwrite(str, strlen(str));
+}
+
+char poll_key(void)
+{
+    int c;
+
+    dma_wait();
+    c = next_key();
+
+    return c == EOF ? 0 : (char)c;
+}
+
+char read_key(void)
+{
+    int c;
+
+    dma_wait();
+    c = next_key();
+
+    if (c == EOF)
+    {
+        fflush(stdout);
+        exit(0);
+    }
+
+    return (char)c;
+}
+
+// Same editing and timeout as the target, running out of input without a
+// timeout counts as one as well
+int read_line(char *buf, int len, int timeout)
+{
+    int count = 0;
+
+    if (timeout > 0)
+    {
+        memory[IO_ADDR(TVR)] = UBASIC_INPUT_TICK;
+        timer_start();
+    }
+
+    for (;;)
+    {
+        char key = timeout == 0 || key_pending() ? poll_key() : 0;
+
+        if (key == 0)
+        {
+            if (timeout == 0)
+            {
+                put_char('\n');
+                return -1;
+            }
+
+            if (timer_expired())
+            {
+                if (--timeout == 0)
+                {
+                    put_char('\n');
+                    return -1;
+                }
+
+                timer_start();
+            }
+            continue;
+        }
+
+        put_char(key);
+
+        if (key == 10)
+        {
+            break;
+        }
+
+        if (key == 8)
+        {
+            if (count > 0)
+            {
+                count--;
+            }
+        }
+        else if (key != 12 && count < len - 1)
+        {
+            buf[count++] = key;
+        }
+    }
+
+    buf[count] = '\0';
+
+    return count;
+}
+
+// No performance counters on the host, cycles count wall clock nanoseconds
+// and retired instructions process CPU time nanoseconds
+
+static uint32_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+
+    return (uint32_t)ts.tv_sec * 1000000000u + (uint32_t)ts.tv_nsec;
+}
+
+uint32_t read_cycles(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+uint32_t read_instret(void)
+{
+    return clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// Section boundaries from the GNU linker, the host heap is a fixed array
+extern char __executable_start, etext, edata, end;
+
+static uint32_t heap[UBASIC_HOST_HEAP_SIZE / sizeof(uint32_t)];
+
+void mem_map(struct mem_map *map)
+{
+    struct rlimit stack;
+
+    getrlimit(RLIMIT_STACK, &stack);
+
+    map->text = &etext - &__executable_start;
+    map->data = &edata - &etext;
+    map->bss = &end - &edata;
+    map->stack = stack.rlim_cur == RLIM_INFINITY ? 0 : (uint32_t)stack.rlim_cur;
+    map->heap = sizeof(heap);
+}
+
+void *mem_heap(uint32_t *size)
+{
+    *size = sizeof(heap);
+
+    return heap;
+}
+
+// The file stands in for memory that outlives a reset, a missing file reads as zeros
+#if UBASIC_CHECKPOINT_SIZE
+static uint32_t noinit[UBASIC_CHECKPOINT_SIZE / sizeof(uint32_t)];
+static int noinit_loaded;
+
+void *mem_noinit(uint32_t *size)
+{
+    if (!noinit_loaded && noinit_path != NULL)
+    {
+        FILE *f = fopen(noinit_path, "rb");
+
+        if (f != NULL)
+        {
+            fread(noinit, 1, sizeof(noinit), f);
+            fclose(f);
+        }
+    }
+
+    noinit_loaded = 1;
+    *size = sizeof(noinit);
+
+    return noinit;
+}
+
+void mem_noinit_sync(void)
+{
+    FILE *f;
+
+    if (noinit_path == NULL || (f = fopen(noinit_path, "wb")) == NULL)
+    {
+        return;
+    }
+
+    fwrite(noinit, 1, sizeof(noinit), f);
+    fclose(f);
+}
+#endif
@@ -0,0 +1,24 @@
+// Simulated Veecom memory and I/O map for host builds
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "vartype.h"
+
+#define SIM_MEMORY_SIZE 0x10000
+#define SIM_IO_BASE 0xfff4 // First register of the I/O map (DAL)
+#define SIM_TIMER_TICK_NS 1000000 // One TVR count of the simulated timer
+
+typedef void (*sim_line_func)(int linenum, char *text, int len);
+
+void sim_init(int argc, char **argv);
+char const *sim_program_path(int argc, char **argv);
+int sim_load(char const *path, sim_line_func line);
+
+VariableType_t sim_peek(VariableType_t addr);
+void sim_poke(VariableType_t addr, VariableType_t val);
+
+void sim_keys(char const *keys, int len);
+int sim_keys_left(void);
+
+#endif
@@ -30,19 +30,79 @@
 
 #include "interperter.h"
 #include "tokenizer.h"
+#include "codegen.h"
 #include "utility.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 VariableType_t expr(void);
+struct string_ref string_expr(void);
+VariableType_t string_number(void);
 
 static struct interperter self;
 
+#if UBASIC_TRACE_SIZE
+#define TRACING self.trace_on
+#else
+#define TRACING 0
+#endif
+
+#if UBASIC_STATS
+#define STAT_COUNT(field) self.stats.field++
+#define STAT_PEAK(field, depth)         \
+    do                                  \
+    {                                   \
+        if ((depth) > self.stats.field) \
+        {                               \
+            self.stats.field = (depth); \
+        }                               \
+    } while (0)
+#else
+#define STAT_COUNT(field)
+#define STAT_PEAK(field, depth)
+#endif
+
+// Named ports are single byte accesses, host builds reach the simulated
+// I/O map through the peek and poke functions
+#if CODEGEN_NATIVE
+#define PORT_READ(addr) (*(volatile uint8_t *)(uintptr_t)(addr))
+#define PORT_WRITE(addr, value) (*(volatile uint8_t *)(uintptr_t)(addr) = (value))
+#else
+#define PORT_READ(addr) (self.peek_function(addr) & 0xff)
+#define PORT_WRITE(addr, value) self.poke_function(addr, (value) & 0xff)
+#endif
+
+static struct codegen_env native_env;
+
+// Splits the program area into equally many program lines and per line tables
+void carve_program_area(void)
+{
+    uint32_t size;
+    char *heap = mem_heap(&size);
+    uint32_t line_bytes = sizeof(struct line_index) + codegen_line_bytes();
+
+#if UBASIC_SUPERINSTRUCTIONS
+    line_bytes += sizeof(struct line_shape);
+#endif
+
+    self.max_lines = size / line_bytes;
+
+    self.program_lines = (struct line_index *)heap;
+    heap += self.max_lines * sizeof(struct line_index);
+#if UBASIC_SUPERINSTRUCTIONS
+    self.shapes = (struct line_shape *)heap;
+    heap += self.max_lines * sizeof(struct line_shape);
+#endif
+    codegen_init(heap, self.max_lines);
+}
+
 void interperter_init(peek_func peek, poke_func poke)
 {
     interperter_reset();
+    carve_program_area();
 
-    for (int i = 0; i < UBASIC_MAX_PROGRAM_LINES; ++i)
+    for (int i = 0; i < self.max_lines; ++i)
     {
         self.program_lines[i].idx = -1;
     }
@@ -50,6 +110,13 @@ void interperter_init(peek_func peek, poke_func poke)
     self.peek_function = peek;
     self.poke_function = poke;
 
+    native_env.variables = self.variables;
+    native_env.print_number = print_number;
+    native_env.write_char = put_char;
+    native_env.write = dma_nwrite;
+    native_env.peek = peek;
+    native_env.poke = poke;
+
     self.bytes_used = 0;
     self.cur_free_lidx = 0;
 }
@@ -60,6 +127,8 @@ void interperter_reset(void)
     self.gosub_stack_ptr = 0;
     self.program_counter = 0;
     self.finished = 0;
+    self.fn_depth = 0;
+    self.timer_period = 0;
 }
 
 int interperter_get_line_num(char *text)
@@ -85,6 +154,14 @@ void set_variable(int varnum, VariableType_t value)
     if (varnum >= 0 && varnum <= MAX_VARNUM)
     {
         self.variables[varnum] = value;
+
+#if UBASIC_TRACE_SIZE
+        if (self.trace_last != NULL)
+        {
+            self.trace_last->var = varnum;
+            self.trace_last->value = value;
+        }
+#endif
     }
 }
 
@@ -109,6 +186,13 @@ void accept(int token)
     tokenizer_next();
 }
 
+// Reports a statement that cannot be carried out and stops the program
+void statement_error(char const *message)
+{
+    dma_write((char *)message);
+    self.finished = 1;
+}
+
 int varfactor(void)
 {
     int r = get_variable(tokenizer_variable_num());
@@ -116,14 +200,187 @@ int varfactor(void)
     return r;
 }
 
+// Register behind a port name, OUT writes the output side and IN reads the input side.
+// Returns 0 for anything that is not a port
+int port_address(int token, int output)
+{
+    switch (token)
+    {
+    case TOKENIZER_PA:
+        return output ? IO_ADDR(PAO) : IO_ADDR(PAI);
+    case TOKENIZER_PB:
+        return output ? IO_ADDR(PBO) : IO_ADDR(PBI);
+    case TOKENIZER_PC:
+        return output ? IO_ADDR(PCO) : IO_ADDR(PCI);
+    case TOKENIZER_TIMER:
+        return output ? IO_ADDR(TCR) : IO_ADDR(TXP);
+    default:
+        return 0;
+    }
+}
+
+// Takes the port name operand of OUT and IN, 0 after a syntax error. The
+// operand is skipped either way so the rest of the statement still parses
+int port_operand(int output)
+{
+    int port = port_address(tokenizer_token(), output);
+
+    if (port == 0)
+    {
+        statement_error("SYNTAX ERROR\n");
+    }
+
+    tokenizer_next();
+
+    return port;
+}
+
+int in_program_store(char const *pos)
+{
+    return pos >= (char const *)self.program_lines &&
+           pos < (char const *)(self.program_lines + self.max_lines);
+}
+
+// Program text stays put until the next edit, which waits for DMA to finish,
+// text typed in direct mode is copied
+void write_text(char const *text, int len)
+{
+    if (in_program_store(text))
+    {
+        dma_start(text, len);
+    }
+    else
+    {
+        dma_nwrite((char *)text, len);
+    }
+}
+
+void fn_clear(void)
+{
+    for (int i = 0; i < MAX_VARNUM; ++i)
+    {
+        self.functions[i].body = NULL;
+    }
+}
+
+#if UBASIC_SUPERINSTRUCTIONS
+void shape_clear(void)
+{
+    for (int i = 0; i < self.max_lines; ++i)
+    {
+        self.shapes[i].kind = SHAPE_UNKNOWN;
+    }
+}
+#endif
+
+// Everything that points into the program store is dropped on edits
+void program_changed(void)
+{
+    // Program text may still be draining through DMA
+    dma_wait();
+    fn_clear();
+#if UBASIC_SUPERINSTRUCTIONS
+    shape_clear();
+#endif
+    codegen_invalidate();
+}
+
+VariableType_t fn_call(void)
+{
+    VariableType_t args[UBASIC_MAX_FN_PARAMS];
+    VariableType_t saved[UBASIC_MAX_FN_PARAMS];
+    struct fn_state *fn = NULL;
+    int argc = 0;
+    int name;
+
+    accept(TOKENIZER_FN);
+    name = tokenizer_variable_num();
+    accept(TOKENIZER_VARIABLE);
+    accept(TOKENIZER_LEFTPAREN);
+
+    while (tokenizer_token() != TOKENIZER_RIGHTPAREN &&
+           tokenizer_token() != TOKENIZER_CR &&
+           tokenizer_token() != TOKENIZER_ENDOFINPUT)
+    {
+        VariableType_t e = expr();
+
+        if (argc < UBASIC_MAX_FN_PARAMS)
+        {
+            args[argc++] = e;
+        }
+
+        if (tokenizer_token() != TOKENIZER_COMMA)
+        {
+            break;
+        }
+
+        tokenizer_next();
+    }
+
+    accept(TOKENIZER_RIGHTPAREN);
+
+    if (name >= 0 && name < MAX_VARNUM)
+    {
+        fn = &self.functions[name];
+    }
+
+    if (fn == NULL || fn->body == NULL || self.fn_depth >= UBASIC_MAX_GOSUB_STACK_DEPTH)
+    {
+        return 0;
+    }
+
+    // Evaluate the body in place, binding the parameters over the globals
+    char const *resume = tokenizer_pos();
+
+    for (int i = 0; i < fn->param_count; ++i)
+    {
+        saved[i] = get_variable(fn->params[i]);
+        set_variable(fn->params[i], i < argc ? args[i] : 0);
+    }
+
+    self.fn_depth++;
+    tokenizer_goto(fn->body);
+    VariableType_t r = expr();
+    self.fn_depth--;
+
+    for (int i = fn->param_count - 1; i >= 0; --i)
+    {
+        set_variable(fn->params[i], saved[i]);
+    }
+
+    tokenizer_goto(resume);
+
+    return r;
+}
+
+int minmax(void)
+{
+    int op = tokenizer_token();
+    int a, b;
+
+    tokenizer_next();
+    accept(TOKENIZER_LEFTPAREN);
+    a = expr();
+    accept(TOKENIZER_COMMA);
+    b = expr();
+    accept(TOKENIZER_RIGHTPAREN);
+
+    if (op == TOKENIZER_MIN)
+    {
+        return a < b ? a : b;
+    }
+
+    return a > b ? a : b;
+}
+
 int factor(void)
 {
-    int r;
+    int r, port;
 
     switch (tokenizer_token())
     {
     case TOKENIZER_NUMBER:
-        r = tokenizer_num();
+        r = tokenizer_value();
         accept(TOKENIZER_NUMBER);
         break;
     case TOKENIZER_LEFTPAREN:
@@ -131,6 +388,49 @@ int factor(void)
         r = expr();
         accept(TOKENIZER_RIGHTPAREN);
         break;
+    case TOKENIZER_FN:
+        r = fn_call();
+        break;
+    case TOKENIZER_MINUS:
+        accept(TOKENIZER_MINUS);
+        r = -factor();
+        break;
+    case TOKENIZER_NOT:
+        accept(TOKENIZER_NOT);
+        r = VARTYPE_FROM_INT(~VARTYPE_TO_INT(factor()));
+        break;
+    case TOKENIZER_ABS:
+        accept(TOKENIZER_ABS);
+        r = factor();
+        r = r < 0 ? -r : r;
+        break;
+    case TOKENIZER_MIN:
+    case TOKENIZER_MAX:
+        r = minmax();
+        break;
+    case TOKENIZER_LEN:
+    case TOKENIZER_ASC:
+        r = string_number();
+        break;
+    case TOKENIZER_CYCLES:
+        accept(TOKENIZER_CYCLES);
+        r = VARTYPE_FROM_INT((int)read_cycles());
+        break;
+    case TOKENIZER_INSTRET:
+        accept(TOKENIZER_INSTRET);
+        r = VARTYPE_FROM_INT((int)read_instret());
+        break;
+    case TOKENIZER_IN:
+        accept(TOKENIZER_IN);
+        accept(TOKENIZER_LEFTPAREN);
+        port = port_operand(0);
+        accept(TOKENIZER_RIGHTPAREN);
+        r = port ? VARTYPE_FROM_INT(PORT_READ(port)) : 0;
+        break;
+    case TOKENIZER_TIMER:
+        accept(TOKENIZER_TIMER);
+        r = VARTYPE_FROM_INT(PORT_READ(IO_ADDR(TVR)));
+        break;
     default:
         r = varfactor();
         break;
@@ -146,7 +446,9 @@ int term(void)
 
     while (op == TOKENIZER_ASTR ||
            op == TOKENIZER_SLASH ||
-           op == TOKENIZER_MOD)
+           op == TOKENIZER_MOD ||
+           op == TOKENIZER_SHL ||
+           op == TOKENIZER_SHR)
     {
         tokenizer_next();
         int f2 = factor();
@@ -154,14 +456,20 @@ int term(void)
         switch (op)
         {
         case TOKENIZER_ASTR:
-            f1 = f1 * f2;
+            f1 = VARTYPE_MUL(f1, f2);
             break;
         case TOKENIZER_SLASH:
-            f1 = f1 / f2;
+            f1 = VARTYPE_DIV(f1, f2);
             break;
         case TOKENIZER_MOD:
             f1 = f1 % f2;
             break;
+        case TOKENIZER_SHL:
+            f1 = f1 << (VARTYPE_TO_INT(f2) & 31);
+            break;
+        case TOKENIZER_SHR:
+            f1 = f1 >> (VARTYPE_TO_INT(f2) & 31);
+            break;
         }
         op = tokenizer_token();
     }
@@ -177,7 +485,8 @@ VariableType_t expr(void)
     while (op == TOKENIZER_PLUS ||
            op == TOKENIZER_MINUS ||
            op == TOKENIZER_AND ||
-           op == TOKENIZER_OR)
+           op == TOKENIZER_OR ||
+           op == TOKENIZER_XOR)
     {
         tokenizer_next();
         int t2 = term();
@@ -196,6 +505,9 @@ VariableType_t expr(void)
         case TOKENIZER_OR:
             t1 = t1 | t2;
             break;
+        case TOKENIZER_XOR:
+            t1 = t1 ^ t2;
+            break;
         }
         op = tokenizer_token();
     }
@@ -203,393 +515,1902 @@ VariableType_t expr(void)
     return t1;
 }
 
-int relation(void)
+int is_string_start(int token)
 {
-    int r1 = expr();
-    int op = tokenizer_token();
+    return token == TOKENIZER_STRING ||
+           token == TOKENIZER_STRINGVAR ||
+           token == TOKENIZER_LEFT ||
+           token == TOKENIZER_RIGHT ||
+           token == TOKENIZER_MID ||
+           token == TOKENIZER_CHR;
+}
 
-    while (op == TOKENIZER_LT ||
-           op == TOKENIZER_GT ||
-           op == TOKENIZER_EQ)
+int string_is_temp(struct string_ref r)
+{
+    return r.ptr >= self.string_arena + self.string_used &&
+           r.ptr < self.string_arena + UBASIC_STRING_ARENA_SIZE;
+}
+
+// Appends src behind dest which must end at the top of the arena,
+// temporaries of src are always above dest so memmove is safe
+struct string_ref string_append(struct string_ref dest, struct string_ref src)
+{
+    char *end = (char *)dest.ptr + dest.len;
+    int room = self.string_arena + UBASIC_STRING_ARENA_SIZE - end;
+
+    if (src.len > room)
     {
-        tokenizer_next();
-        int r2 = expr();
+        src.len = room;
+        self.string_overflow = 1;
+    }
 
-        switch (op)
+    memmove(end, src.ptr, src.len);
+    dest.len += src.len;
+    self.string_temp = end + src.len - self.string_arena;
+
+    return dest;
+}
+
+struct string_ref string_temp_ref(void)
+{
+    struct string_ref r = {self.string_arena + self.string_temp, 0};
+    return r;
+}
+
+void string_compact(void)
+{
+    int used = 0;
+
+    // Slide live strings down in address order, each one only moves towards
+    // space that has already been vacated
+    for (;;)
+    {
+        struct string_var *next = NULL;
+
+        for (int i = 0; i < MAX_VARNUM; ++i)
+        {
+            struct string_var *v = &self.string_vars[i];
+
+            if (v->len > 0 && v->offset >= used &&
+                (next == NULL || v->offset < next->offset))
+            {
+                next = v;
+            }
+        }
+
+        if (next == NULL)
         {
-        case TOKENIZER_LT:
-            r1 = r1 < r2;
-            break;
-        case TOKENIZER_GT:
-            r1 = r1 > r2;
-            break;
-        case TOKENIZER_EQ:
-            r1 = r1 == r2;
             break;
         }
-        op = tokenizer_token();
+
+        memmove(self.string_arena + used, self.string_arena + next->offset, next->len);
+        next->offset = used;
+        used += next->len;
     }
 
-    return r1;
+    self.string_used = used;
+    self.string_temp = used;
+    self.string_garbage = 0;
 }
 
-struct line_index index_find(int linenum)
+// Compacts the arena with r still in use. Temporaries sit above every
+// variable and stay put, r into a variable follows it
+struct string_ref string_compact_ref(struct string_ref r)
 {
-    struct line_index find = {.idx = -1};
+    struct string_var *owner = NULL;
+    int delta = 0;
 
-    for (int i = 0; i < self.cur_free_lidx + 1; ++i)
+    for (int i = 0; i < MAX_VARNUM && !string_is_temp(r); ++i)
     {
-        if (self.program_lines[i].line_number == linenum)
+        struct string_var *v = &self.string_vars[i];
+        char const *start = self.string_arena + v->offset;
+
+        if (v->len > 0 && r.ptr >= start && r.ptr < start + v->len)
         {
-            find = self.program_lines[i];
+            owner = v;
+            delta = r.ptr - start;
             break;
         }
     }
 
-    return find;
+    string_compact();
+
+    if (owner != NULL)
+    {
+        r.ptr = self.string_arena + owner->offset + delta;
+    }
+
+    return r;
 }
 
-void index_insert(struct line_index lidx)
+// Compacts ahead of a statement while room is short, so the arena rarely
+// has to be compacted with references taken
+void string_reclaim(void)
 {
-    for (int i = 0; i < self.cur_free_lidx + 1; ++i)
+    if (self.string_garbage > 0 &&
+        UBASIC_STRING_ARENA_SIZE - self.string_used < UBASIC_MAX_STRINGLEN)
     {
-        if (self.program_lines[i].idx == -1)
-        {
-            self.program_lines[i] = lidx;
-            return;
-        }
+        string_compact();
+    }
+}
 
-        if (self.program_lines[i].line_number > lidx.line_number)
-        {
-            struct line_index temp = self.program_lines[i];
-            temp.idx = lidx.idx;
-            self.program_lines[i] = lidx;
-            self.program_lines[i].idx = i;
-            lidx = temp;
-        }
+// string_expr for a statement that holds no other string, a temporary that
+// ran out of room is built again after compacting
+struct string_ref string_eval(void)
+{
+    char const *start = tokenizer_pos();
+    struct string_ref r;
+
+    self.string_overflow = 0;
+    r = string_expr();
+
+    if (self.string_overflow && self.string_garbage > 0)
+    {
+        string_compact();
+        self.string_overflow = 0;
+        tokenizer_goto(start);
+        r = string_expr();
+    }
+
+    if (self.string_overflow)
+    {
+        statement_error("OUT OF STRING SPACE\n");
     }
+
+    return r;
 }
 
-void interperter_add_line(int linenum, char *text, int len)
+void string_assign(int var, struct string_ref r)
 {
-    if (self.cur_free_lidx >= UBASIC_MAX_PROGRAM_LINES)
+    if (var < 0 || var >= MAX_VARNUM)
     {
         return;
     }
 
-    int idx = index_find(linenum).idx;
+    if (r.len > UBASIC_STRING_ARENA_SIZE - self.string_used && self.string_garbage > 0)
+    {
+        r = string_compact_ref(r);
+    }
 
-    if (idx != -1)
+    char *dest = self.string_arena + self.string_used;
+    int room = UBASIC_STRING_ARENA_SIZE - self.string_used;
+
+    if (r.len > room)
     {
-        memcpy(self.program_lines[idx].text, text, len);
+        statement_error("OUT OF STRING SPACE\n");
         return;
     }
 
-    struct line_index new_lidx = {
-        .line_number = linenum,
-        .idx = self.cur_free_lidx++,
-        .len = len,
-    };
+    // Temporaries are committed where they are, anything else is copied once
+    if (r.ptr != dest)
+    {
+        memmove(dest, r.ptr, r.len);
+    }
 
-    memcpy(new_lidx.text, text, len);
-    index_insert(new_lidx);
-    self.bytes_used += len;
+    self.string_garbage += self.string_vars[var].len;
+    self.string_vars[var].offset = self.string_used;
+    self.string_vars[var].len = r.len;
+    self.string_used += r.len;
+    self.string_temp = self.string_used;
 }
 
-void goto_statement(void)
+struct string_ref string_slice(struct string_ref r, int start, int len)
 {
-    accept(TOKENIZER_GOTO);
-    self.program_counter = index_find(tokenizer_num()).idx;
+    if (start < 0)
+    {
+        start = 0;
+    }
+
+    if (start > r.len)
+    {
+        start = r.len;
+    }
+
+    if (len < 0 || len > r.len - start)
+    {
+        len = r.len - start;
+    }
+
+    r.ptr += start;
+    r.len = len;
+
+    return r;
 }
 
-void print_statement(void)
+struct string_ref string_factor(void)
 {
-    accept(TOKENIZER_PRINT);
+    struct string_ref r = {self.string_arena, 0};
+    int token = tokenizer_token();
+    int var, n, m;
 
-    do
+    switch (token)
     {
-        if (tokenizer_token() == TOKENIZER_STRING)
+    case TOKENIZER_STRING:
+        r.ptr = tokenizer_literal(&r.len);
+        accept(TOKENIZER_STRING);
+        break;
+    case TOKENIZER_STRINGVAR:
+        var = tokenizer_variable_num();
+        accept(TOKENIZER_STRINGVAR);
+
+        if (var >= 0 && var < MAX_VARNUM)
         {
-            int strlen = tokenizer_string(self.string, UBASIC_MAX_STRINGLEN);
-            dma_nwrite(self.string, strlen);
-            tokenizer_next();
+            r.ptr = self.string_arena + self.string_vars[var].offset;
+            r.len = self.string_vars[var].len;
         }
-        else if (tokenizer_token() == TOKENIZER_COMMA)
+        break;
+    case TOKENIZER_LEFT:
+    case TOKENIZER_RIGHT:
+        accept(token);
+        accept(TOKENIZER_LEFTPAREN);
+        r = string_expr();
+        accept(TOKENIZER_COMMA);
+        n = VARTYPE_TO_INT(expr());
+        accept(TOKENIZER_RIGHTPAREN);
+        n = n < 0 ? 0 : n;
+        r = string_slice(r, token == TOKENIZER_LEFT ? 0 : r.len - n, n);
+        break;
+    case TOKENIZER_MID:
+        accept(TOKENIZER_MID);
+        accept(TOKENIZER_LEFTPAREN);
+        r = string_expr();
+        accept(TOKENIZER_COMMA);
+        n = VARTYPE_TO_INT(expr());
+        m = -1;
+
+        if (tokenizer_token() == TOKENIZER_COMMA)
         {
-            put_char(' ');
-            tokenizer_next();
+            accept(TOKENIZER_COMMA);
+            m = VARTYPE_TO_INT(expr());
+            m = m < 0 ? 0 : m;
         }
-        else if (tokenizer_token() == TOKENIZER_SEMICOLON)
+
+        accept(TOKENIZER_RIGHTPAREN);
+        r = string_slice(r, n - 1, m);
+        break;
+    case TOKENIZER_CHR:
+        accept(TOKENIZER_CHR);
+        n = VARTYPE_TO_INT(factor());
+
+        if (self.string_temp < UBASIC_STRING_ARENA_SIZE)
         {
-            tokenizer_next();
+            r = string_temp_ref();
+            self.string_arena[self.string_temp++] = n;
+            r.len = 1;
         }
         else
         {
-            VariableType_t e = expr();
-            itoa(e, self.numstr, 10);
-            dma_nwrite(self.numstr, UBASIC_MAX_NUMLEN);
+            self.string_overflow = 1;
         }
-    } while (tokenizer_token() != TOKENIZER_CR &&
-             tokenizer_token() != TOKENIZER_ENDOFINPUT);
+        break;
+    default:
+        break;
+    }
 
-    put_char('\n');
-    tokenizer_next();
+    return r;
 }
 
-void if_statement(void)
+struct string_ref string_expr(void)
 {
-    int r;
+    struct string_ref r = string_factor();
+
+    while (tokenizer_token() == TOKENIZER_PLUS)
+    {
+        tokenizer_next();
+
+        if (!string_is_temp(r))
+        {
+            r = string_append(string_temp_ref(), r);
+        }
+
+        r = string_append(r, string_factor());
+    }
+
+    return r;
+}
+
+VariableType_t string_number(void)
+{
+    int token = tokenizer_token();
+    struct string_ref r;
+
+    accept(token);
+    accept(TOKENIZER_LEFTPAREN);
+    r = string_expr();
+    accept(TOKENIZER_RIGHTPAREN);
+
+    if (token == TOKENIZER_LEN)
+    {
+        return VARTYPE_FROM_INT(r.len);
+    }
+
+    return VARTYPE_FROM_INT(r.len > 0 ? (unsigned char)r.ptr[0] : 0);
+}
+
+int string_relation(void)
+{
+    struct string_ref r1 = string_expr();
+    int op = tokenizer_token();
+    struct string_ref r2;
+    int cmp;
+
+    tokenizer_next();
+    r2 = string_expr();
+
+    cmp = memcmp(r1.ptr, r2.ptr, r1.len < r2.len ? r1.len : r2.len);
+
+    if (cmp == 0)
+    {
+        cmp = r1.len - r2.len;
+    }
+
+    switch (op)
+    {
+    case TOKENIZER_LT:
+        return cmp < 0;
+    case TOKENIZER_GT:
+        return cmp > 0;
+    case TOKENIZER_EQ:
+        return cmp == 0;
+    case TOKENIZER_LE:
+        return cmp <= 0;
+    case TOKENIZER_GE:
+        return cmp >= 0;
+    case TOKENIZER_NE:
+        return cmp != 0;
+    }
+
+    return 0;
+}
+
+int relation(void)
+{
+    if (is_string_start(tokenizer_token()))
+    {
+        return string_relation();
+    }
+
+    int r1 = expr();
+    int op = tokenizer_token();
+
+    while (op == TOKENIZER_LT ||
+           op == TOKENIZER_GT ||
+           op == TOKENIZER_EQ ||
+           op == TOKENIZER_LE ||
+           op == TOKENIZER_GE ||
+           op == TOKENIZER_NE)
+    {
+        tokenizer_next();
+        int r2 = expr();
+
+        switch (op)
+        {
+        case TOKENIZER_LT:
+            r1 = r1 < r2;
+            break;
+        case TOKENIZER_GT:
+            r1 = r1 > r2;
+            break;
+        case TOKENIZER_EQ:
+            r1 = r1 == r2;
+            break;
+        case TOKENIZER_LE:
+            r1 = r1 <= r2;
+            break;
+        case TOKENIZER_GE:
+            r1 = r1 >= r2;
+            break;
+        case TOKENIZER_NE:
+            r1 = r1 != r2;
+            break;
+        }
+        op = tokenizer_token();
+    }
+
+    return r1;
+}
+
+struct line_index index_find(int linenum)
+{
+    struct line_index find = {.idx = -1};
+
+    for (int i = 0; i < self.cur_free_lidx + 1; ++i)
+    {
+        if (self.program_lines[i].line_number == linenum)
+        {
+            find = self.program_lines[i];
+            break;
+        }
+    }
+
+    return find;
+}
+
+void index_insert(struct line_index lidx)
+{
+    for (int i = 0; i < self.cur_free_lidx + 1; ++i)
+    {
+        if (self.program_lines[i].idx == -1)
+        {
+            self.program_lines[i] = lidx;
+            return;
+        }
+
+        if (self.program_lines[i].line_number > lidx.line_number)
+        {
+            struct line_index temp = self.program_lines[i];
+            temp.idx = lidx.idx;
+            self.program_lines[i] = lidx;
+            self.program_lines[i].idx = i;
+            lidx = temp;
+        }
+    }
+}
+
+void interperter_add_line(int linenum, char *text, int len)
+{
+    if (self.cur_free_lidx >= self.max_lines)
+    {
+        return;
+    }
+
+    int idx = index_find(linenum).idx;
+
+    program_changed();
+
+    if (idx != -1)
+    {
+        memcpy(self.program_lines[idx].text, text, len);
+        return;
+    }
+
+    struct line_index new_lidx = {
+        .line_number = linenum,
+        .idx = self.cur_free_lidx++,
+        .len = len,
+    };
+
+    memcpy(new_lidx.text, text, len);
+    index_insert(new_lidx);
+    self.bytes_used += len;
+}
+
+void goto_statement(void)
+{
+    accept(TOKENIZER_GOTO);
+    STAT_COUNT(lookups);
+    self.program_counter = index_find(tokenizer_num()).idx;
+}
+
+int format_number(char *buf, VariableType_t value)
+{
+    char digits[VARTYPE_MAX_STRLEN];
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+    uint32_t whole = magnitude >> VARTYPE_FRAC_BITS;
+    int len = 0;
+    int n = 0;
+
+#if UBASIC_FIXED_POINT
+    uint32_t scale = 1;
+
+    for (int i = 0; i < UBASIC_FIXED_POINT_DIGITS; ++i)
+    {
+        scale *= 10;
+    }
+
+    // Round the fraction to the printed number of digits
+    uint32_t frac = ((magnitude & 0xffff) * scale + 0x8000) >> VARTYPE_FRAC_BITS;
+
+    if (frac >= scale)
+    {
+        frac -= scale;
+        whole++;
+    }
+
+    for (int i = 0; i < UBASIC_FIXED_POINT_DIGITS; ++i, frac /= 10)
+    {
+        if (n > 0 || frac % 10 != 0)
+        {
+            digits[n++] = '0' + frac % 10;
+        }
+    }
+
+    if (n > 0)
+    {
+        digits[n++] = '.';
+    }
+#endif
+
+    do
+    {
+        digits[n++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole != 0);
+
+    if (value < 0)
+    {
+        digits[n++] = '-';
+    }
+
+    while (n > 0)
+    {
+        buf[len++] = digits[--n];
+    }
+
+    buf[len] = '\0';
+
+    return len;
+}
+
+void print_number(VariableType_t value)
+{
+    dma_nwrite(self.numstr, format_number(self.numstr, value));
+}
+
+void print_statement(void)
+{
+    accept(TOKENIZER_PRINT);
+
+    do
+    {
+        int token = tokenizer_token();
+
+        // A literal on its own is written in place, one that starts a
+        // string expression is evaluated like any other
+        if (token == TOKENIZER_STRING)
+        {
+            char const *start = tokenizer_pos();
+            int len;
+            char const *text = tokenizer_literal(&len);
+
+            tokenizer_next();
+            token = tokenizer_token();
+
+            if (token == TOKENIZER_SEMICOLON || token == TOKENIZER_COMMA ||
+                token == TOKENIZER_CR || token == TOKENIZER_ENDOFINPUT)
+            {
+                write_text(text, len);
+                continue;
+            }
+
+            tokenizer_goto(start);
+            token = TOKENIZER_STRING;
+        }
+
+        if (is_string_start(token))
+        {
+            struct string_ref r = string_eval();
+            dma_nwrite((char *)r.ptr, r.len);
+        }
+        else if (token == TOKENIZER_COMMA)
+        {
+            put_char(' ');
+            tokenizer_next();
+        }
+        else if (token == TOKENIZER_SEMICOLON)
+        {
+            tokenizer_next();
+        }
+        else
+        {
+            print_number(expr());
+        }
+    } while (tokenizer_token() != TOKENIZER_CR &&
+             tokenizer_token() != TOKENIZER_ENDOFINPUT);
+
+    put_char('\n');
+    tokenizer_next();
+}
+
+void if_statement(void)
+{
+    int r;
 
     accept(TOKENIZER_IF);
 
     r = relation();
 
-    accept(TOKENIZER_THEN);
+    accept(TOKENIZER_THEN);
+
+    if (r)
+    {
+        interperter_execute();
+    }
+
+    accept(TOKENIZER_CR);
+}
+
+void string_let_statement(void)
+{
+    int var = tokenizer_variable_num();
+
+    accept(TOKENIZER_STRINGVAR);
+    accept(TOKENIZER_EQ);
+
+    string_reclaim();
+    string_assign(var, string_eval());
+    accept(TOKENIZER_CR);
+}
+
+void let_statement(void)
+{
+    if (tokenizer_token() == TOKENIZER_STRINGVAR)
+    {
+        string_let_statement();
+        return;
+    }
+
+    int var = tokenizer_variable_num();
+
+    accept(TOKENIZER_VARIABLE);
+    accept(TOKENIZER_EQ);
+    set_variable(var, expr());
+    accept(TOKENIZER_CR);
+}
+
+void gosub_statement(void)
+{
+    int linenum;
+
+    accept(TOKENIZER_GOSUB);
+    linenum = tokenizer_num();
+
+    accept(TOKENIZER_NUMBER);
+    accept(TOKENIZER_CR);
+
+    if (self.gosub_stack_ptr < UBASIC_MAX_GOSUB_STACK_DEPTH)
+    {
+        self.gosub_stack[self.gosub_stack_ptr] = self.program_counter;
+        self.gosub_stack_ptr++;
+        STAT_PEAK(gosub_peak, self.gosub_stack_ptr);
+        STAT_COUNT(lookups);
+        self.program_counter = index_find(linenum).idx;
+    }
+}
+
+void return_statement(void)
+{
+    accept(TOKENIZER_RETURN);
+
+    if (self.gosub_stack_ptr > 0)
+    {
+        self.gosub_stack_ptr--;
+        self.program_counter = self.gosub_stack[self.gosub_stack_ptr];
+
+        if (self.gosub_stack_ptr == self.timer_depth)
+        {
+            self.timer_depth = -1;
+        }
+    }
+}
+
+void next_statement(void)
+{
+    int var;
+
+    accept(TOKENIZER_NEXT);
+    var = tokenizer_variable_num();
+    accept(TOKENIZER_VARIABLE);
+
+    if (self.for_stack_ptr > 0 && var == self.for_stack[self.for_stack_ptr - 1].for_variable)
+    {
+        struct for_state *loop = &self.for_stack[self.for_stack_ptr - 1];
+        VariableType_t value = get_variable(var) + VARTYPE_FROM_INT(1);
+
+        set_variable(var, value);
+
+        if (value <= loop->to)
+        {
+            self.program_counter = loop->line_after_for;
+        }
+        else
+        {
+            self.for_stack_ptr--;
+            accept(TOKENIZER_CR);
+        }
+    }
+    else
+    {
+        accept(TOKENIZER_CR);
+    }
+}
+
+void for_statement(void)
+{
+    int for_variable, to;
+
+    accept(TOKENIZER_FOR);
+    for_variable = tokenizer_variable_num();
+
+    accept(TOKENIZER_VARIABLE);
+    accept(TOKENIZER_EQ);
+
+    set_variable(for_variable, expr());
+    accept(TOKENIZER_TO);
+
+    to = expr();
+    accept(TOKENIZER_CR);
+
+    if (self.for_stack_ptr < UBASIC_MAX_FOR_STACK_DEPTH)
+    {
+        self.for_stack[self.for_stack_ptr].line_after_for = self.program_counter;
+        self.for_stack[self.for_stack_ptr].for_variable = for_variable;
+        self.for_stack[self.for_stack_ptr].to = to;
+        self.for_stack_ptr++;
+        STAT_PEAK(for_peak, self.for_stack_ptr);
+    }
+}
+
+void peek_statement(void)
+{
+    VariableType_t peek_addr;
+    VariableType_t var;
+
+    accept(TOKENIZER_PEEK);
+    peek_addr = expr();
+
+    accept(TOKENIZER_COMMA);
+    var = tokenizer_variable_num();
+
+    accept(TOKENIZER_VARIABLE);
+    accept(TOKENIZER_CR);
+
+    set_variable(var, VARTYPE_FROM_INT(self.peek_function(VARTYPE_TO_ADDR(peek_addr))));
+}
+
+void poke_statement(void)
+{
+    VariableType_t poke_addr;
+    VariableType_t value;
+
+    accept(TOKENIZER_POKE);
+    poke_addr = expr();
+
+    accept(TOKENIZER_COMMA);
+    value = expr();
+
+    accept(TOKENIZER_CR);
+
+    self.poke_function(VARTYPE_TO_ADDR(poke_addr), VARTYPE_TO_INT(value));
+}
+
+void out_statement(void)
+{
+    int port;
+    VariableType_t value;
+
+    accept(TOKENIZER_OUT);
+    port = port_operand(1);
+
+    accept(TOKENIZER_COMMA);
+    value = expr();
+
+    accept(TOKENIZER_CR);
+
+    if (port)
+    {
+        PORT_WRITE(port, VARTYPE_TO_INT(value));
+    }
+}
+
+// One shot timer, re-armed on every expiry so the handler runs periodically
+void timer_arm(void)
+{
+    PORT_WRITE(IO_ADDR(TVR), self.timer_period);
+    PORT_WRITE(IO_ADDR(TCR), 0x01);
+}
+
+void on_statement(void)
+{
+    int linenum;
+    VariableType_t period;
+
+    accept(TOKENIZER_ON);
+    accept(TOKENIZER_TIMER);
+
+    if (tokenizer_token() == TOKENIZER_OFF)
+    {
+        accept(TOKENIZER_OFF);
+        accept(TOKENIZER_CR);
+        self.timer_period = 0;
+        return;
+    }
+
+    period = expr();
+    accept(TOKENIZER_GOSUB);
+    linenum = tokenizer_num();
+    accept(TOKENIZER_NUMBER);
+    accept(TOKENIZER_CR);
+
+    self.timer_slot = index_find(linenum).idx;
+    self.timer_period = self.timer_slot == -1 ? 0 : VARTYPE_TO_INT(period) & 0xff;
+    self.timer_depth = -1;
+
+    if (self.timer_period)
+    {
+        timer_arm();
+    }
+}
+
+// Enters the ON TIMER handler like a GOSUB from the line about to run,
+// a handler is not entered again before it returns
+void timer_dispatch(void)
+{
+    if (self.timer_depth != -1 || self.gosub_stack_ptr >= UBASIC_MAX_GOSUB_STACK_DEPTH)
+    {
+        return;
+    }
+
+    self.timer_depth = self.gosub_stack_ptr;
+    self.gosub_stack[self.gosub_stack_ptr] = self.program_counter;
+    self.gosub_stack_ptr++;
+    STAT_PEAK(gosub_peak, self.gosub_stack_ptr);
+    self.program_counter = self.timer_slot;
+
+    timer_arm();
+}
+
+// INPUT T, "PROMPT"; ... takes T as the timeout, INPUT T, A reads into both
+int timeout_variable(void)
+{
+    char const *start = tokenizer_pos();
+    int prompt = 0;
+
+    if (tokenizer_token() != TOKENIZER_VARIABLE)
+    {
+        return 0;
+    }
+
+    tokenizer_next();
+
+    if (tokenizer_token() == TOKENIZER_COMMA)
+    {
+        tokenizer_next();
+        prompt = tokenizer_token() == TOKENIZER_STRING;
+    }
+
+    tokenizer_goto(start);
+
+    return prompt;
+}
+
+void input_statement(void)
+{
+    int timeout = 0;
+    int len;
+
+    accept(TOKENIZER_INPUT);
+
+    if (tokenizer_token() == TOKENIZER_NUMBER ||
+        tokenizer_token() == TOKENIZER_LEFTPAREN ||
+        timeout_variable())
+    {
+        timeout = VARTYPE_TO_INT(expr());
+        accept(TOKENIZER_COMMA);
+    }
+
+    if (tokenizer_token() == TOKENIZER_STRING)
+    {
+        struct string_ref prompt = string_factor();
+        write_text(prompt.ptr, prompt.len);
+        accept(TOKENIZER_SEMICOLON);
+    }
+
+    dma_write("? ");
+
+    // The scratch string buffer doubles as the line buffer
+    len = read_line(self.string, UBASIC_MAX_STRINGLEN, timeout);
+
+    // A timeout restarts the shared timer, ON TIMER gets a whole period again
+    if (timeout > 0 && self.timer_period)
+    {
+        timer_arm();
+    }
+
+    char const *field = self.string;
+    char const *end = self.string + (len < 0 ? 0 : len);
+
+    string_reclaim();
+
+    while (tokenizer_token() == TOKENIZER_VARIABLE ||
+           tokenizer_token() == TOKENIZER_STRINGVAR)
+    {
+        int token = tokenizer_token();
+        int var = tokenizer_variable_num();
+        char const *next = field;
+
+        accept(token);
+
+        while (next < end && *next != ',')
+        {
+            ++next;
+        }
+
+        // Only the last variable takes the rest of the line including commas
+        if (tokenizer_token() != TOKENIZER_COMMA)
+        {
+            next = end;
+        }
+
+        if (len >= 0)
+        {
+            if (token == TOKENIZER_STRINGVAR)
+            {
+                struct string_ref r = {field, next - field};
+                string_assign(var, r);
+            }
+            else
+            {
+                set_variable(var, tokenizer_parse_number(&field));
+            }
+        }
+
+        field = next < end ? next + 1 : end;
+
+        if (tokenizer_token() != TOKENIZER_COMMA)
+        {
+            break;
+        }
+
+        accept(TOKENIZER_COMMA);
+    }
+
+    accept(TOKENIZER_CR);
+}
+
+void end_statement(void)
+{
+    accept(TOKENIZER_END);
+    self.finished = 1;
+}
+
+void def_statement(void)
+{
+    struct fn_state fn = {.param_count = 0};
+    int name;
+
+    accept(TOKENIZER_DEF);
+    accept(TOKENIZER_FN);
+    name = tokenizer_variable_num();
+
+    accept(TOKENIZER_VARIABLE);
+    accept(TOKENIZER_LEFTPAREN);
+
+    while (tokenizer_token() == TOKENIZER_VARIABLE)
+    {
+        if (fn.param_count < UBASIC_MAX_FN_PARAMS)
+        {
+            fn.params[(int)fn.param_count++] = tokenizer_variable_num();
+        }
+
+        accept(TOKENIZER_VARIABLE);
+
+        if (tokenizer_token() == TOKENIZER_COMMA)
+        {
+            tokenizer_next();
+        }
+    }
+
+    accept(TOKENIZER_RIGHTPAREN);
+    accept(TOKENIZER_EQ);
+
+    // The body is only remembered, it gets evaluated by fn_call
+    fn.body = tokenizer_pos();
+
+    while (tokenizer_token() != TOKENIZER_CR &&
+           tokenizer_token() != TOKENIZER_ENDOFINPUT)
+    {
+        tokenizer_next();
+    }
+
+    accept(TOKENIZER_CR);
+
+    // Direct mode lines live in the input buffer and get overwritten
+    if (name >= 0 && name < MAX_VARNUM && in_program_store(fn.body))
+    {
+        self.functions[name] = fn;
+    }
+}
+
+void new_statement(void)
+{
+    accept(TOKENIZER_NEW);
+    accept(TOKENIZER_CR);
+
+    for (int i = 0; i < self.cur_free_lidx; ++i)
+    {
+        self.program_lines[i].idx = -1;
+    }
+
+    self.cur_free_lidx = 0;
+    self.bytes_used = 0;
+    program_changed();
+}
+
+#if UBASIC_SUPERINSTRUCTIONS
+int is_relation(int token)
+{
+    return token == TOKENIZER_LT ||
+           token == TOKENIZER_GT ||
+           token == TOKENIZER_EQ ||
+           token == TOKENIZER_LE ||
+           token == TOKENIZER_GE ||
+           token == TOKENIZER_NE;
+}
+
+int compare(int op, VariableType_t a, VariableType_t b)
+{
+    switch (op)
+    {
+    case TOKENIZER_LT:
+        return a < b;
+    case TOKENIZER_GT:
+        return a > b;
+    case TOKENIZER_EQ:
+        return a == b;
+    case TOKENIZER_LE:
+        return a <= b;
+    case TOKENIZER_GE:
+        return a >= b;
+    }
+
+    return a != b;
+}
+
+// POKE followed by a plain variable or number, returns its kind or 0
+int shape_address(struct line_shape *shape)
+{
+    accept(TOKENIZER_POKE);
+
+    if (tokenizer_token() == TOKENIZER_VARIABLE)
+    {
+        shape->var = tokenizer_variable_num();
+    }
+    else if (tokenizer_token() == TOKENIZER_NUMBER)
+    {
+        shape->var = -1;
+        shape->value = tokenizer_value();
+    }
+    else
+    {
+        return 0;
+    }
+
+    tokenizer_next();
+
+    return tokenizer_token() == TOKENIZER_COMMA;
+}
+
+// Classifies a line once, the generic path stays in charge of anything unusual
+void shape_analyze(int slot)
+{
+    struct line_shape *shape = &self.shapes[slot];
+    char const *text = self.program_lines[slot].text;
+    int var, op;
+
+    shape->kind = SHAPE_GENERIC;
+
+    tokenizer_init(text);
+    accept(TOKENIZER_NUMBER);
+
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_LET:
+        tokenizer_next();
+        /* Fall through. */
+    case TOKENIZER_VARIABLE:
+        var = tokenizer_variable_num();
+        accept(TOKENIZER_VARIABLE);
+        accept(TOKENIZER_EQ);
+
+        if (tokenizer_token() != TOKENIZER_VARIABLE || tokenizer_variable_num() != var)
+        {
+            return;
+        }
+
+        tokenizer_next();
+        op = tokenizer_token();
+
+        if (op != TOKENIZER_PLUS && op != TOKENIZER_MINUS)
+        {
+            return;
+        }
+
+        tokenizer_next();
+
+        if (tokenizer_token() != TOKENIZER_NUMBER)
+        {
+            return;
+        }
+
+        shape->value = op == TOKENIZER_PLUS ? tokenizer_value() : -tokenizer_value();
+        tokenizer_next();
+
+        if (tokenizer_token() == TOKENIZER_CR)
+        {
+            shape->var = var;
+            shape->kind = SHAPE_INCREMENT;
+        }
+        break;
+    case TOKENIZER_IF:
+        tokenizer_next();
+        shape->expr = tokenizer_pos() - text;
+        shape->var = tokenizer_token() == TOKENIZER_VARIABLE ? tokenizer_variable_num() : -1;
+
+        // Skip the left side, a single variable needs no tokenizing at all
+        for (int n = 0; !is_relation(tokenizer_token()); ++n)
+        {
+            if (tokenizer_token() == TOKENIZER_CR ||
+                tokenizer_token() == TOKENIZER_ENDOFINPUT ||
+                tokenizer_token() == TOKENIZER_THEN ||
+                is_string_start(tokenizer_token()))
+            {
+                return;
+            }
+
+            if (n > 0)
+            {
+                shape->var = -1;
+            }
+
+            tokenizer_next();
+        }
+
+        shape->op = tokenizer_token();
+        tokenizer_next();
+
+        if (tokenizer_token() != TOKENIZER_NUMBER)
+        {
+            return;
+        }
+
+        shape->value = tokenizer_value();
+        tokenizer_next();
+
+        if (tokenizer_token() != TOKENIZER_THEN)
+        {
+            return;
+        }
+
+        tokenizer_next();
+
+        if (tokenizer_token() != TOKENIZER_GOTO)
+        {
+            return;
+        }
+
+        tokenizer_next();
+        shape->target = index_find(tokenizer_num()).idx;
+        accept(TOKENIZER_NUMBER);
+
+        if (tokenizer_token() == TOKENIZER_CR && shape->target != -1)
+        {
+            shape->kind = SHAPE_BRANCH;
+        }
+        break;
+    case TOKENIZER_NEXT:
+        tokenizer_next();
+        var = tokenizer_variable_num();
+        accept(TOKENIZER_VARIABLE);
+
+        if (tokenizer_token() == TOKENIZER_CR)
+        {
+            shape->var = var;
+            shape->kind = SHAPE_NEXT;
+        }
+        break;
+    case TOKENIZER_POKE:
+    {
+        struct line_shape next;
+
+        // Only fuse with the slot run_statement would visit next
+        if (slot + 1 >= self.cur_free_lidx ||
+            self.program_lines[slot + 1].idx == -1 ||
+            !shape_address(shape))
+        {
+            return;
+        }
+
+        tokenizer_init(self.program_lines[slot + 1].text);
+        accept(TOKENIZER_NUMBER);
+
+        if (tokenizer_token() != TOKENIZER_POKE || !shape_address(&next) || next.var != shape->var)
+        {
+            return;
+        }
+
+        if (next.var == -1 && next.value != shape->value)
+        {
+            return;
+        }
+
+        tokenizer_next();
+
+        if (tokenizer_token() != TOKENIZER_NUMBER || tokenizer_value() != 0)
+        {
+            return;
+        }
+
+        tokenizer_next();
+
+        if (tokenizer_token() == TOKENIZER_CR)
+        {
+            shape->kind = SHAPE_STROBE;
+        }
+        break;
+    }
+    }
+}
+
+// Runs the line through its fused handler, returns 0 for the generic path
+int shape_execute(int slot)
+{
+    struct line_shape *shape = &self.shapes[slot];
+    char const *text = self.program_lines[slot].text;
+    VariableType_t v;
+
+    if (shape->kind == SHAPE_UNKNOWN)
+    {
+        shape_analyze(slot);
+    }
+
+    switch (shape->kind)
+    {
+    case SHAPE_INCREMENT:
+        self.variables[shape->var] += shape->value;
+        return 1;
+    case SHAPE_BRANCH:
+        if (shape->var >= 0)
+        {
+            v = self.variables[shape->var];
+        }
+        else
+        {
+            tokenizer_goto(text + shape->expr);
+            v = expr();
+        }
+
+        if (compare(shape->op, v, shape->value))
+        {
+            self.program_counter = shape->target;
+        }
+        return 1;
+    case SHAPE_STROBE:
+        // The value still goes through the generic POKE, the clearing write is fused
+        tokenizer_init(text);
+        accept(TOKENIZER_NUMBER);
+        poke_statement();
+
+        v = shape->var >= 0 ? self.variables[shape->var] : shape->value;
+        self.poke_function(VARTYPE_TO_ADDR(v), 0);
+        self.program_counter++;
+        return 1;
+    case SHAPE_NEXT:
+        // next_statement without tokenizing the line, the loop state stays in for_stack
+        if (self.for_stack_ptr > 0)
+        {
+            struct for_state *loop = &self.for_stack[self.for_stack_ptr - 1];
+
+            if (loop->for_variable == shape->var)
+            {
+                v = self.variables[shape->var] + VARTYPE_FROM_INT(1);
+                self.variables[shape->var] = v;
+
+                if (v <= loop->to)
+                {
+                    self.program_counter = loop->line_after_for;
+                }
+                else
+                {
+                    self.for_stack_ptr--;
+                }
+            }
+        }
+        return 1;
+    }
+
+    return 0;
+}
+#endif
+
+#if UBASIC_TRACE_SIZE
+void trace_record(int line_number, int token)
+{
+    struct trace_entry *entry = &self.trace[self.trace_head];
+
+    entry->line_number = line_number;
+    entry->token = token;
+    entry->var = -1;
+
+    self.trace_last = entry;
+    self.trace_head = (self.trace_head + 1) % UBASIC_TRACE_SIZE;
+
+    if (self.trace_count < UBASIC_TRACE_SIZE)
+    {
+        self.trace_count++;
+    }
+}
+
+// Prints the last n entries, oldest first
+void trace_dump(int n)
+{
+    int i;
+
+    if (n > self.trace_count)
+    {
+        n = self.trace_count;
+    }
+
+    i = (self.trace_head + UBASIC_TRACE_SIZE - n) % UBASIC_TRACE_SIZE;
+
+    for (; n > 0; --n, i = (i + 1) % UBASIC_TRACE_SIZE)
+    {
+        struct trace_entry *entry = &self.trace[i];
+        char const *keyword = tokenizer_keyword(entry->token);
+
+        if (keyword == NULL)
+        {
+            keyword = entry->token == TOKENIZER_VARIABLE || entry->token == TOKENIZER_STRINGVAR ? "LET" : "?";
+        }
+
+        print_number(VARTYPE_FROM_INT(entry->line_number));
+        put_char(' ');
+        dma_write((char *)keyword);
+
+        if (entry->var >= 0)
+        {
+            put_char(' ');
+            put_char('A' + entry->var);
+            put_char('=');
+            print_number(entry->value);
+        }
+
+        put_char('\n');
+    }
+}
+
+void trace_statement(void)
+{
+    accept(TOKENIZER_TRACE);
+
+    if (tokenizer_token() == TOKENIZER_ON)
+    {
+        accept(TOKENIZER_ON);
+        self.trace_head = 0;
+        self.trace_count = 0;
+        self.trace_on = 1;
+    }
+    else if (tokenizer_token() == TOKENIZER_OFF)
+    {
+        accept(TOKENIZER_OFF);
+        self.trace_on = 0;
+
+        // Later assignments must not land in the entry for this line
+        self.trace_last = NULL;
+    }
+    else if (tokenizer_token() == TOKENIZER_NUMBER)
+    {
+        trace_dump(tokenizer_num());
+        accept(TOKENIZER_NUMBER);
+    }
+    else
+    {
+        trace_dump(UBASIC_TRACE_SIZE);
+    }
+
+    accept(TOKENIZER_CR);
+}
+#endif
+
+// Runs from program_counter until the program ends or leaves the slots up to last
+void run_lines(int last)
+{
+    while (self.program_counter < self.cur_free_lidx && self.program_counter <= last)
+    {
+        if (self.finished)
+        {
+            break;
+        }
+
+        if (self.timer_period && (PORT_READ(IO_ADDR(TXP)) & 0x01))
+        {
+            timer_dispatch();
+        }
+
+        int slot = self.program_counter++;
+        struct line_index *lidx = &self.program_lines[slot];
+
+        if (lidx->idx == -1)
+        {
+            continue;
+        }
+
+        if (!TRACING)
+        {
+            int next = codegen_line(self.program_lines, self.cur_free_lidx, slot, &native_env);
+
+            if (next == CODEGEN_LINE_END)
+            {
+                STAT_COUNT(native);
+                self.finished = 1;
+                continue;
+            }
+
+            if (next != CODEGEN_LINE_INTERPRET)
+            {
+                STAT_COUNT(native);
+                self.program_counter = next;
+                continue;
+            }
+
+#if UBASIC_SUPERINSTRUCTIONS
+            if (shape_execute(slot))
+            {
+                STAT_COUNT(fused);
+                continue;
+            }
+#endif
+        }
+
+        tokenizer_init(lidx->text);
+        accept(TOKENIZER_NUMBER);
+
+#if UBASIC_TRACE_SIZE
+        if (self.trace_on)
+        {
+            trace_record(lidx->line_number, tokenizer_token());
+        }
+#endif
+
+        interperter_execute();
+    }
+
+#if UBASIC_TRACE_SIZE
+    self.trace_last = NULL;
+#endif
+}
+
+void run_statement(void)
+{
+    accept(TOKENIZER_RUN);
+    accept(TOKENIZER_CR);
+
+    if (self.bytes_used == 0)
+    {
+        return;
+    }
+
+    interperter_reset();
 
-    if (r)
+    // Tracing needs every statement to pass through the interpreter
+    if (!TRACING && codegen_execute())
     {
-        interperter_execute();
+        return;
     }
 
-    accept(TOKENIZER_CR);
+    run_lines(self.cur_free_lidx - 1);
 }
 
-void let_statement(void)
+// Parses the LIST style N, N-M, -M and N- ranges into slots,
+// returns 0 when a line number does not exist
+int line_range(int *start, int *end)
 {
-    int var = tokenizer_variable_num();
+    *start = 0;
+    *end = self.cur_free_lidx - 1;
 
-    accept(TOKENIZER_VARIABLE);
-    accept(TOKENIZER_EQ);
-    set_variable(var, expr());
-    accept(TOKENIZER_CR);
-}
+    switch (tokenizer_token())
+    {
+    case TOKENIZER_NUMBER:
+        *start = index_find(tokenizer_num()).idx;
+        tokenizer_next();
 
-void gosub_statement(void)
-{
-    int linenum;
+        if (tokenizer_token() == TOKENIZER_CR)
+        {
+            *end = *start;
+        }
+        else if (tokenizer_token() == TOKENIZER_MINUS)
+        {
+            tokenizer_next();
 
-    accept(TOKENIZER_GOSUB);
-    linenum = tokenizer_num();
+            if (tokenizer_token() == TOKENIZER_NUMBER)
+            {
+                *end = index_find(tokenizer_num()).idx;
+            }
+        }
+        break;
+    case TOKENIZER_MINUS:
+        tokenizer_next();
+        if (tokenizer_token() == TOKENIZER_NUMBER)
+        {
+            *end = index_find(tokenizer_num()).idx;
+        }
+        break;
+    default:
+        break;
+    }
 
-    accept(TOKENIZER_NUMBER);
-    accept(TOKENIZER_CR);
+    return *start != -1 && *end != -1;
+}
 
-    if (self.gosub_stack_ptr < UBASIC_MAX_GOSUB_STACK_DEPTH)
+void list_statement(void)
+{
+    if (self.bytes_used == 0)
     {
-        self.gosub_stack[self.gosub_stack_ptr] = self.program_counter;
-        self.gosub_stack_ptr++;
-        self.program_counter = index_find(linenum).idx;
+        put_char('\n');
+        return;
     }
-}
 
-void return_statement(void)
-{
-    accept(TOKENIZER_RETURN);
+    accept(TOKENIZER_LIST);
 
-    if (self.gosub_stack_ptr > 0)
+    int start, end;
+
+    if (!line_range(&start, &end))
     {
-        self.gosub_stack_ptr--;
-        self.program_counter = self.gosub_stack[self.gosub_stack_ptr];
+        put_char('\n');
+        return;
     }
-}
 
-void next_statement(void)
-{
-    int var;
+    // Lines are packed into one chunk while the DMA engine drains the other,
+    // so a listing costs one transfer per chunk instead of one per line
+    int chunk = 0;
+    int fill = 0;
 
-    accept(TOKENIZER_NEXT);
-    var = tokenizer_variable_num();
-    accept(TOKENIZER_VARIABLE);
+    dma_wait();
 
-    if (self.for_stack_ptr > 0 && var == self.for_stack[self.for_stack_ptr - 1].for_variable)
+    for (int i = start; i <= end; ++i)
     {
-        set_variable(var, get_variable(var) + 1);
+        struct line_index *lidx = &self.program_lines[i];
 
-        if (get_variable(var) <= self.for_stack[self.for_stack_ptr - 1].to)
+        if (lidx->idx == -1)
         {
-            self.program_counter = self.for_stack[self.for_stack_ptr - 1].line_after_for;
+            continue;
         }
-        else
+
+        if (fill + lidx->len > UBASIC_LIST_CHUNK_SIZE)
         {
-            self.for_stack_ptr--;
-            accept(TOKENIZER_CR);
+            dma_start(self.list_chunks[chunk], fill);
+            chunk ^= 1;
+            fill = 0;
         }
+
+        memcpy(self.list_chunks[chunk] + fill, lidx->text, lidx->len);
+        fill += lidx->len;
     }
-    else
+
+    if (fill > 0)
     {
-        accept(TOKENIZER_CR);
+        dma_start(self.list_chunks[chunk], fill);
     }
 }
 
-void for_statement(void)
+// Runs a range of lines and reports what it cost
+// Runs the range from fresh stacks, a program that times part of itself
+// carries on afterwards with its own loops, subroutines and handler
+void time_statement(void)
 {
-    int for_variable, to;
+    struct for_state for_stack[UBASIC_MAX_FOR_STACK_DEPTH];
+    int gosub_stack[UBASIC_MAX_GOSUB_STACK_DEPTH];
+    int for_stack_ptr = self.for_stack_ptr;
+    int gosub_stack_ptr = self.gosub_stack_ptr;
+    int program_counter = self.program_counter;
+    int fn_depth = self.fn_depth;
+    int timer_period = self.timer_period;
+    int timer_slot = self.timer_slot;
+    int timer_depth = self.timer_depth;
+    char const *rest;
+    int start, end;
+
+    accept(TOKENIZER_TIME);
+
+    if (self.bytes_used == 0 || !line_range(&start, &end))
+    {
+        put_char('\n');
+        return;
+    }
 
-    accept(TOKENIZER_FOR);
-    for_variable = tokenizer_variable_num();
+    while (tokenizer_token() != TOKENIZER_CR && tokenizer_token() != TOKENIZER_ENDOFINPUT)
+    {
+        tokenizer_next();
+    }
 
-    accept(TOKENIZER_VARIABLE);
-    accept(TOKENIZER_EQ);
+    rest = tokenizer_pos();
+    memcpy(for_stack, self.for_stack, sizeof(for_stack));
+    memcpy(gosub_stack, self.gosub_stack, sizeof(gosub_stack));
 
-    set_variable(for_variable, expr());
-    accept(TOKENIZER_TO);
+    interperter_reset();
+    self.program_counter = start;
 
-    to = expr();
-    accept(TOKENIZER_CR);
+    uint32_t cycles = read_cycles();
+    uint32_t instret = read_instret();
 
-    if (self.for_stack_ptr < UBASIC_MAX_FOR_STACK_DEPTH)
+    run_lines(end);
+
+    instret = read_instret() - instret;
+    cycles = read_cycles() - cycles;
+
+    sprintf(self.string, "%u CYCLES %u INSTRET\n", (unsigned)cycles, (unsigned)instret);
+    dma_write(self.string);
+
+    memcpy(self.for_stack, for_stack, sizeof(for_stack));
+    memcpy(self.gosub_stack, gosub_stack, sizeof(gosub_stack));
+    self.for_stack_ptr = for_stack_ptr;
+    self.gosub_stack_ptr = gosub_stack_ptr;
+    self.program_counter = program_counter;
+    self.fn_depth = fn_depth;
+    self.timer_period = timer_period;
+    self.timer_slot = timer_slot;
+    self.timer_depth = timer_depth;
+    self.finished = 0;
+
+    if (self.timer_period)
     {
-        self.for_stack[self.for_stack_ptr].line_after_for = self.program_counter;
-        self.for_stack[self.for_stack_ptr].for_variable = for_variable;
-        self.for_stack[self.for_stack_ptr].to = to;
-        self.for_stack_ptr++;
+        timer_arm();
     }
+
+    tokenizer_goto(rest);
+    accept(TOKENIZER_CR);
 }
 
-void peek_statement(void)
+#if UBASIC_STATS
+static void stats_line(char const *name, uint32_t value)
 {
-    VariableType_t peek_addr;
-    VariableType_t var;
+    sprintf(self.string, "%s %u\n", name, (unsigned)value);
+    dma_write(self.string);
+}
 
-    accept(TOKENIZER_PEEK);
-    peek_addr = expr();
+// Prints the counters gathered since the last STATS and clears them
+void stats_statement(void)
+{
+    accept(TOKENIZER_STATS);
+    accept(TOKENIZER_CR);
 
-    accept(TOKENIZER_COMMA);
-    var = tokenizer_variable_num();
+    struct io_stats io = io_stats;
+    uint32_t tokens = tokenizer_stats();
 
-    accept(TOKENIZER_VARIABLE);
-    accept(TOKENIZER_CR);
+    for (int token = 0; token < TOKENIZER_FN; ++token)
+    {
+        if (self.stats.statements[token] != 0)
+        {
+            stats_line(tokenizer_keyword(token), self.stats.statements[token]);
+        }
+    }
 
-    set_variable(var, self.peek_function(peek_addr));
+    stats_line("FUSED LINES", self.stats.fused);
+    stats_line("NATIVE LINES", self.stats.native);
+    stats_line("LINE LOOKUPS", self.stats.lookups);
+    stats_line("TOKENS", tokens);
+    stats_line("DMA BYTES", io.dma_bytes);
+    stats_line("CHARS", io.chars);
+    stats_line("FOR DEPTH", self.stats.for_peak);
+    stats_line("GOSUB DEPTH", self.stats.gosub_peak);
+
+    memset(&self.stats, 0, sizeof(self.stats));
+    memset(&io_stats, 0, sizeof(io_stats));
 }
+#endif
 
-void poke_statement(void)
+#if UBASIC_CHECKPOINT_SIZE
+#define CHECKPOINT_MAGIC 0x55424350 // "UBCP"
+
+// Runtime state and the program store as CHECKPOINT leaves them in the
+// memory mem_noinit keeps across resets. Functions are kept as offsets
+// into the program store so they survive a different load address
+struct checkpoint
 {
-    VariableType_t poke_addr;
-    VariableType_t value;
+    uint32_t magic;
+    uint32_t sum; // FNV-1a of everything from size to the last line
+    uint32_t size;
+    int lines;
+    int bytes_used;
+    int program_counter;
+    VariableType_t variables[MAX_VARNUM];
+    struct for_state for_stack[UBASIC_MAX_FOR_STACK_DEPTH];
+    int for_stack_ptr;
+    int gosub_stack[UBASIC_MAX_GOSUB_STACK_DEPTH];
+    int gosub_stack_ptr;
+    struct fn_state functions[MAX_VARNUM];
+    int fn_offsets[MAX_VARNUM];
+    char string_arena[UBASIC_STRING_ARENA_SIZE];
+    struct string_var string_vars[MAX_VARNUM];
+    int string_used;
+    int string_garbage;
+    int timer_period;
+    int timer_slot;
+    int timer_depth;
+    struct line_index program[];
+};
+
+static uint32_t checkpoint_sum(struct checkpoint const *cp)
+{
+    uint8_t const *p = (uint8_t const *)&cp->size;
+    uint8_t const *end = (uint8_t const *)cp + cp->size;
+    uint32_t sum = 2166136261u;
 
-    accept(TOKENIZER_POKE);
-    poke_addr = expr();
+    while (p < end)
+    {
+        sum = (sum ^ *p++) * 16777619u;
+    }
 
-    accept(TOKENIZER_COMMA);
-    value = expr();
+    return sum;
+}
 
-    accept(TOKENIZER_CR);
+int checkpoint_save(void)
+{
+    uint32_t room;
+    struct checkpoint *cp = mem_noinit(&room);
+    uint32_t size = sizeof(*cp) + self.cur_free_lidx * sizeof(struct line_index);
+
+    if (size > room)
+    {
+        return 0;
+    }
+
+    cp->magic = 0;
+    cp->size = size;
+    cp->lines = self.cur_free_lidx;
+    cp->bytes_used = self.bytes_used;
+    cp->program_counter = self.program_counter;
+    memcpy(cp->variables, self.variables, sizeof(self.variables));
+    memcpy(cp->for_stack, self.for_stack, sizeof(self.for_stack));
+    cp->for_stack_ptr = self.for_stack_ptr;
+    memcpy(cp->gosub_stack, self.gosub_stack, sizeof(self.gosub_stack));
+    cp->gosub_stack_ptr = self.gosub_stack_ptr;
+    memcpy(cp->functions, self.functions, sizeof(self.functions));
+    memcpy(cp->string_arena, self.string_arena, sizeof(self.string_arena));
+    memcpy(cp->string_vars, self.string_vars, sizeof(self.string_vars));
+    cp->string_used = self.string_used;
+    cp->string_garbage = self.string_garbage;
+    cp->timer_period = self.timer_period;
+    cp->timer_slot = self.timer_slot;
+    cp->timer_depth = self.timer_depth;
+
+    for (int i = 0; i < MAX_VARNUM; ++i)
+    {
+        char const *body = self.functions[i].body;
 
-    self.poke_function(poke_addr, value);
+        cp->functions[i].body = NULL;
+        cp->fn_offsets[i] = body ? body - (char const *)self.program_lines : -1;
+    }
+
+    memcpy(cp->program, self.program_lines, self.cur_free_lidx * sizeof(struct line_index));
+
+    cp->sum = checkpoint_sum(cp);
+    cp->magic = CHECKPOINT_MAGIC;
+    mem_noinit_sync();
+
+    return 1;
 }
 
-void end_statement(void)
+// Returns 0 and leaves everything alone unless a complete checkpoint fits this build
+int checkpoint_restore(void)
 {
-    accept(TOKENIZER_END);
-    self.finished = 1;
+    uint32_t room;
+    struct checkpoint const *cp = mem_noinit(&room);
+
+    if (cp->magic != CHECKPOINT_MAGIC || cp->size < sizeof(*cp) || cp->size > room ||
+        cp->lines < 0 || cp->lines > self.max_lines ||
+        cp->size != sizeof(*cp) + cp->lines * sizeof(struct line_index) ||
+        checkpoint_sum(cp) != cp->sum)
+    {
+        return 0;
+    }
+
+    // Shapes, native code and functions of the old program go first
+    program_changed();
+
+    memcpy(self.program_lines, cp->program, cp->lines * sizeof(struct line_index));
+    self.cur_free_lidx = cp->lines;
+    self.bytes_used = cp->bytes_used;
+    self.program_counter = cp->program_counter;
+    memcpy(self.variables, cp->variables, sizeof(self.variables));
+    memcpy(self.for_stack, cp->for_stack, sizeof(self.for_stack));
+    self.for_stack_ptr = cp->for_stack_ptr;
+    memcpy(self.gosub_stack, cp->gosub_stack, sizeof(self.gosub_stack));
+    self.gosub_stack_ptr = cp->gosub_stack_ptr;
+    memcpy(self.functions, cp->functions, sizeof(self.functions));
+    memcpy(self.string_arena, cp->string_arena, sizeof(self.string_arena));
+    memcpy(self.string_vars, cp->string_vars, sizeof(self.string_vars));
+    self.string_used = cp->string_used;
+    self.string_garbage = cp->string_garbage;
+    self.timer_period = cp->timer_period;
+    self.timer_slot = cp->timer_slot;
+    self.timer_depth = cp->timer_depth;
+
+    for (int i = 0; i < MAX_VARNUM; ++i)
+    {
+        if (cp->fn_offsets[i] != -1)
+        {
+            self.functions[i].body = (char const *)self.program_lines + cp->fn_offsets[i];
+        }
+    }
+
+    return 1;
 }
 
-void new_statement(void)
+void checkpoint_statement(void)
 {
-    accept(TOKENIZER_NEW);
+    accept(TOKENIZER_CHECKPOINT);
     accept(TOKENIZER_CR);
 
-    for (int i = 0; i < self.cur_free_lidx; ++i)
+    if (!checkpoint_save())
     {
-        self.program_lines[i].idx = -1;
+        dma_write("CHECKPOINT TOO LARGE\n");
     }
-
-    self.cur_free_lidx = 0;
-    self.bytes_used = 0;
 }
 
-void run_statement(void)
+// Carries on after the last CHECKPOINT as if the reset never happened
+void resume_statement(void)
 {
-    accept(TOKENIZER_RUN);
+    accept(TOKENIZER_RESUME);
     accept(TOKENIZER_CR);
 
-    if (self.bytes_used == 0)
+    if (!checkpoint_restore())
     {
+        dma_write("NO CHECKPOINT\n");
         return;
     }
 
-    interperter_reset();
+    self.finished = 0;
 
-    while (self.program_counter < self.cur_free_lidx)
+    if (self.timer_period)
     {
-        if (self.finished)
-        {
-            return;
-        }
+        timer_arm();
+    }
 
-        struct line_index lidx = self.program_lines[self.program_counter++];
+    run_lines(self.cur_free_lidx - 1);
+}
+#endif
 
-        if (lidx.idx == -1)
-        {
-            continue;
-        }
+static void mem_line(char const *name, uint32_t bytes)
+{
+    sprintf(self.string, "%s %u BYTES\n", name, (unsigned)bytes);
+    dma_write(self.string);
+}
 
-        tokenizer_init(lidx.text);
-        accept(TOKENIZER_NUMBER);
-        interperter_execute();
-    }
+// Image, stack and the program area between them
+void mem_statement(void)
+{
+    struct mem_map map;
+
+    accept(TOKENIZER_MEM);
+    accept(TOKENIZER_CR);
+
+    mem_map(&map);
+
+    mem_line("TEXT", map.text);
+    mem_line("DATA", map.data);
+    mem_line("BSS", map.bss);
+    mem_line("STACK", map.stack);
+    mem_line("HEAP", map.heap);
+    mem_line("PROGRAM", self.bytes_used);
 }
 
-void list_statement(void)
+void compile_statement(void)
 {
-    if (self.bytes_used == 0)
-    {
-        put_char('\n');
-        return;
-    }
+    int error_line;
+    int size;
 
-    accept(TOKENIZER_LIST);
+    accept(TOKENIZER_COMPILE);
+    accept(TOKENIZER_CR);
 
-    int start = 0;
-    int end = self.cur_free_lidx - 1;
+    size = codegen_compile(self.program_lines, self.cur_free_lidx, &native_env, &error_line);
 
-    switch (tokenizer_token())
+    if (size < 0)
     {
-    case TOKENIZER_NUMBER:
-        start = index_find(tokenizer_num()).idx;
-        tokenizer_next();
-
-        if (tokenizer_token() == TOKENIZER_CR)
-        {
-            end = start;
-        }
-        else if (tokenizer_token() == TOKENIZER_MINUS)
-        {
-            tokenizer_next();
+        dma_write("CANNOT COMPILE");
 
-            if (tokenizer_token() == TOKENIZER_NUMBER)
-            {
-                end = index_find(tokenizer_num()).idx;
-            }
-        }
-        break;
-    case TOKENIZER_MINUS:
-        tokenizer_next();
-        if (tokenizer_token() == TOKENIZER_NUMBER)
+        if (error_line != -1)
         {
-            end = index_find(tokenizer_num()).idx;
+            dma_write(" LINE ");
+            print_number(error_line);
         }
-        break;
-    default:
-        break;
-    }
 
-    if (start == -1 || end == -1)
-    {
         put_char('\n');
         return;
     }
 
-    for (int i = start; i <= end; ++i)
-    {
-        if (self.program_lines[i].idx == -1)
-        {
-            continue;
-        }
-
-        dma_nwrite(self.program_lines[i].text, self.program_lines[i].len);
-    }
+    print_number(size);
+    dma_write(" NATIVE BYTES\n");
 }
 
 void fre_statement(void)
@@ -597,7 +2418,7 @@ void fre_statement(void)
     accept(TOKENIZER_FRE);
     accept(TOKENIZER_CR);
 
-    sprintf(self.string, "%d uBASIC BYTES FREE\n");
+    sprintf(self.string, "%u uBASIC BYTES FREE\n", (unsigned)interperter_bytes_free());
     dma_write(self.string);
 }
 
@@ -612,11 +2433,12 @@ void interperter_remove_line(int linenum)
 
     self.program_lines[idx].idx = -1;
     self.bytes_used -= self.program_lines[idx].len;
+    program_changed();
 }
 
 uint16_t interperter_bytes_free(void)
 {
-    return UBASIC_FREE_BYTES - self.bytes_used;
+    return self.max_lines * UBASIC_PROGRAM_LINE_WIDTH - self.bytes_used;
 }
 
 void interperter_execute(void)
@@ -625,6 +2447,20 @@ void interperter_execute(void)
 
     token = tokenizer_token();
 
+    // String temporaries only live for a single statement
+    self.string_temp = self.string_used;
+
+#if UBASIC_STATS
+    if (token == TOKENIZER_VARIABLE || token == TOKENIZER_STRINGVAR)
+    {
+        STAT_COUNT(statements[TOKENIZER_LET]);
+    }
+    else if (token >= TOKENIZER_LET && token < TOKENIZER_FN)
+    {
+        STAT_COUNT(statements[token]);
+    }
+#endif
+
     switch (token)
     {
     case TOKENIZER_PRINT:
@@ -661,6 +2497,7 @@ void interperter_execute(void)
         accept(TOKENIZER_LET);
         /* Fall through. */
     case TOKENIZER_VARIABLE:
+    case TOKENIZER_STRINGVAR:
         let_statement();
         break;
     case TOKENIZER_NEW:
@@ -675,6 +2512,45 @@ void interperter_execute(void)
     case TOKENIZER_FRE:
         fre_statement();
         break;
+    case TOKENIZER_DEF:
+        def_statement();
+        break;
+    case TOKENIZER_INPUT:
+        input_statement();
+        break;
+    case TOKENIZER_COMPILE:
+        compile_statement();
+        break;
+    case TOKENIZER_TIME:
+        time_statement();
+        break;
+    case TOKENIZER_MEM:
+        mem_statement();
+        break;
+    case TOKENIZER_OUT:
+        out_statement();
+        break;
+    case TOKENIZER_ON:
+        on_statement();
+        break;
+#if UBASIC_CHECKPOINT_SIZE
+    case TOKENIZER_CHECKPOINT:
+        checkpoint_statement();
+        break;
+    case TOKENIZER_RESUME:
+        resume_statement();
+        break;
+#endif
+#if UBASIC_STATS
+    case TOKENIZER_STATS:
+        stats_statement();
+        break;
+#endif
+#if UBASIC_TRACE_SIZE
+    case TOKENIZER_TRACE:
+        trace_statement();
+        break;
+#endif
     default:
         self.finished = 1;
         break;
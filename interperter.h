@@ -33,6 +33,8 @@
 
 #include <stdint.h>
 #include "ubasic_version.h"
+#include "vartype.h"
+#include "tokenizer.h"
 
 #define MAX_VARNUM 26
 
@@ -43,6 +45,25 @@ struct for_state
     int to;
 };
 
+struct fn_state
+{
+    char const *body;
+    char params[UBASIC_MAX_FN_PARAMS];
+    char param_count;
+};
+
+struct string_var
+{
+    uint16_t offset;
+    uint16_t len;
+};
+
+struct string_ref
+{
+    char const *ptr;
+    int len;
+};
+
 struct line_index
 {
     char text[UBASIC_PROGRAM_LINE_WIDTH];
@@ -51,25 +72,93 @@ struct line_index
     int len;
 };
 
+// Statement shapes run_statement executes without the generic dispatch
+enum
+{
+    SHAPE_UNKNOWN,
+    SHAPE_GENERIC,
+    SHAPE_INCREMENT, // LET V = V + n
+    SHAPE_BRANCH,    // IF e op n THEN GOTO m
+    SHAPE_STROBE,    // POKE a, e followed by POKE a, 0
+    SHAPE_NEXT,      // NEXT V
+};
+
+struct line_shape
+{
+    uint8_t kind;
+    uint8_t op;
+    int8_t var;
+    uint8_t expr;
+    int16_t target;
+    VariableType_t value;
+};
+
+struct trace_entry
+{
+    int line_number;
+    VariableType_t value;
+    uint8_t token;
+    int8_t var;
+};
+
+// Counters printed and cleared by STATS, statements are indexed by keyword
+// token with implicit assignments counted as LET
+struct stats
+{
+    uint32_t statements[TOKENIZER_FN];
+    uint32_t fused;
+    uint32_t native;
+    uint32_t lookups;
+    uint8_t for_peak;
+    uint8_t gosub_peak;
+};
+
 typedef VariableType_t (*peek_func)(VariableType_t);
 typedef void (*poke_func)(VariableType_t, VariableType_t);
 
 struct interperter
 {
-    struct line_index program_lines[UBASIC_MAX_PROGRAM_LINES];
+    // Carved from the program area by interperter_init
+    struct line_index *program_lines;
+#if UBASIC_SUPERINSTRUCTIONS
+    struct line_shape *shapes;
+#endif
+    int max_lines;
     struct for_state for_stack[UBASIC_MAX_FOR_STACK_DEPTH];
     VariableType_t variables[MAX_VARNUM];
+    struct fn_state functions[MAX_VARNUM];
+    int fn_depth;
     char string[UBASIC_MAX_STRINGLEN];
-    char numstr[UBASIC_MAX_NUMLEN];
+    char string_arena[UBASIC_STRING_ARENA_SIZE];
+    struct string_var string_vars[MAX_VARNUM];
+    int string_used;
+    int string_temp;
+    int string_garbage;
+    int string_overflow; // A temporary was cut short by the end of the arena
+    char numstr[VARTYPE_MAX_STRLEN];
+    char list_chunks[2][UBASIC_LIST_CHUNK_SIZE];
     int for_stack_ptr;
     int gosub_stack[UBASIC_MAX_GOSUB_STACK_DEPTH];
     int gosub_stack_ptr;
+    int timer_period; // ON TIMER period in TVR counts, 0 when disarmed
+    int timer_slot;
+    int timer_depth; // GOSUB depth the running handler returns to, or -1
     int cur_free_lidx;
     int program_counter;
     int finished;
     int bytes_used;
     peek_func peek_function;
     poke_func poke_function;
+#if UBASIC_TRACE_SIZE
+    struct trace_entry trace[UBASIC_TRACE_SIZE];
+    struct trace_entry *trace_last;
+    uint16_t trace_head;
+    uint16_t trace_count;
+    uint8_t trace_on;
+#endif
+#if UBASIC_STATS
+    struct stats stats;
+#endif
 };
 
 void interperter_init(peek_func peek, poke_func poke);
@@ -80,5 +169,7 @@ int interperter_indexed_line_empty(void);
 void interperter_add_line(int linenum, char *text, int len);
 void interperter_remove_line(int linenum);
 uint16_t interperter_bytes_free(void);
+int port_address(int token, int output);
+void print_number(VariableType_t value);
 
 #endif
\ No newline at end of file
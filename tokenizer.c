@@ -39,31 +39,70 @@ static char const *ptr, *nextptr;
 struct keyword_token
 {
   char *keyword;
+  uint8_t len;
   int token;
 };
 
+#define KEYWORD(text, token) {text, sizeof(text) - 1, token}
+
 static int current_token = TOKENIZER_ERROR;
+static int literal_len;
+
+#if UBASIC_STATS
+static uint32_t lexed;
+#endif
 
 static const struct keyword_token keywords[] = {
-    {"LET", TOKENIZER_LET},
-    {"PRINT", TOKENIZER_PRINT},
-    {"IF", TOKENIZER_IF},
-    {"THEN", TOKENIZER_THEN},
-    {"FOR", TOKENIZER_FOR},
-    {"TO", TOKENIZER_TO},
-    {"NEXT", TOKENIZER_NEXT},
-    {"GOTO", TOKENIZER_GOTO},
-    {"GOSUB", TOKENIZER_GOSUB},
-    {"RETURN", TOKENIZER_RETURN},
-    {"REM", TOKENIZER_REM},
-    {"PEEK", TOKENIZER_PEEK},
-    {"POKE", TOKENIZER_POKE},
-    {"END", TOKENIZER_END},
-    {"NEW", TOKENIZER_NEW},
-    {"RUN", TOKENIZER_RUN},
-    {"LIST", TOKENIZER_LIST},
-    {"FRE", TOKENIZER_FRE},
-    {NULL, TOKENIZER_ERROR},
+    KEYWORD("LET", TOKENIZER_LET),
+    KEYWORD("PRINT", TOKENIZER_PRINT),
+    KEYWORD("IF", TOKENIZER_IF),
+    KEYWORD("THEN", TOKENIZER_THEN),
+    KEYWORD("FOR", TOKENIZER_FOR),
+    KEYWORD("TO", TOKENIZER_TO),
+    KEYWORD("NEXT", TOKENIZER_NEXT),
+    KEYWORD("GOTO", TOKENIZER_GOTO),
+    KEYWORD("GOSUB", TOKENIZER_GOSUB),
+    KEYWORD("RETURN", TOKENIZER_RETURN),
+    KEYWORD("REM", TOKENIZER_REM),
+    KEYWORD("PEEK", TOKENIZER_PEEK),
+    KEYWORD("POKE", TOKENIZER_POKE),
+    KEYWORD("END", TOKENIZER_END),
+    KEYWORD("NEW", TOKENIZER_NEW),
+    KEYWORD("RUN", TOKENIZER_RUN),
+    KEYWORD("LIST", TOKENIZER_LIST),
+    KEYWORD("INPUT", TOKENIZER_INPUT),
+    KEYWORD("FRE", TOKENIZER_FRE),
+    KEYWORD("DEF", TOKENIZER_DEF),
+    KEYWORD("COMPILE", TOKENIZER_COMPILE),
+    KEYWORD("TRACE", TOKENIZER_TRACE),
+    KEYWORD("ON", TOKENIZER_ON),
+    KEYWORD("OFF", TOKENIZER_OFF),
+    // Keywords are prefix matched, a longer keyword sharing a prefix must come first
+    KEYWORD("TIMER", TOKENIZER_TIMER),
+    KEYWORD("TIME", TOKENIZER_TIME),
+    KEYWORD("STATS", TOKENIZER_STATS),
+    KEYWORD("MEM", TOKENIZER_MEM),
+    KEYWORD("OUT", TOKENIZER_OUT),
+    KEYWORD("CHECKPOINT", TOKENIZER_CHECKPOINT),
+    KEYWORD("RESUME", TOKENIZER_RESUME),
+    KEYWORD("FN", TOKENIZER_FN),
+    KEYWORD("NOT", TOKENIZER_NOT),
+    KEYWORD("ABS", TOKENIZER_ABS),
+    KEYWORD("MIN", TOKENIZER_MIN),
+    KEYWORD("MAX", TOKENIZER_MAX),
+    KEYWORD("LEFT$", TOKENIZER_LEFT),
+    KEYWORD("RIGHT$", TOKENIZER_RIGHT),
+    KEYWORD("MID$", TOKENIZER_MID),
+    KEYWORD("CHR$", TOKENIZER_CHR),
+    KEYWORD("LEN", TOKENIZER_LEN),
+    KEYWORD("ASC", TOKENIZER_ASC),
+    KEYWORD("CYCLES", TOKENIZER_CYCLES),
+    KEYWORD("INSTRET", TOKENIZER_INSTRET),
+    KEYWORD("IN", TOKENIZER_IN),
+    KEYWORD("PA", TOKENIZER_PA),
+    KEYWORD("PB", TOKENIZER_PB),
+    KEYWORD("PC", TOKENIZER_PC),
+    {NULL, 0, TOKENIZER_ERROR},
 };
 
 static int singlechar(void)
@@ -90,6 +129,8 @@ static int singlechar(void)
     return TOKENIZER_SLASH;
   case '%':
     return TOKENIZER_MOD;
+  case '^':
+    return TOKENIZER_XOR;
   case '(':
     return TOKENIZER_LEFTPAREN;
   case ')':
@@ -105,11 +146,45 @@ static int singlechar(void)
   return 0;
 }
 
+static int doublechar(void)
+{
+  switch (*ptr)
+  {
+  case '<':
+    switch (ptr[1])
+    {
+    case '<':
+      return TOKENIZER_SHL;
+    case '=':
+      return TOKENIZER_LE;
+    case '>':
+      return TOKENIZER_NE;
+    }
+    break;
+  case '>':
+    switch (ptr[1])
+    {
+    case '>':
+      return TOKENIZER_SHR;
+    case '=':
+      return TOKENIZER_GE;
+    }
+    break;
+  }
+
+  return 0;
+}
+
 static int get_next_token(void)
 {
   struct keyword_token const *kt;
+  int token;
   int i = 0;
-  
+
+#if UBASIC_STATS
+  lexed++;
+#endif
+
   if (*ptr == 0)
   {
     return TOKENIZER_ENDOFINPUT;
@@ -121,6 +196,15 @@ static int get_next_token(void)
     {
       if (!isdigit(ptr[i]))
       {
+#if UBASIC_FIXED_POINT
+        if (ptr[i] == '.')
+        {
+          do
+          {
+            ++i;
+          } while (isdigit(ptr[i]));
+        }
+#endif
         nextptr = ptr + i;
         return TOKENIZER_NUMBER;
       }
@@ -130,10 +214,16 @@ static int get_next_token(void)
     return TOKENIZER_ERROR;
   }
 
-  if (singlechar())
+  if ((token = doublechar()))
+  {
+    nextptr = ptr + 2;
+    return token;
+  }
+
+  if ((token = singlechar()))
   {
     nextptr = ptr + 1;
-    return singlechar();
+    return token;
   }
 
   if (*ptr == '"')
@@ -144,26 +234,34 @@ static int get_next_token(void)
       ++nextptr;
     } while (*nextptr != '"');
 
+    literal_len = nextptr - ptr - 1;
     ++nextptr;
     return TOKENIZER_STRING;
   }
 
+  if (*ptr < 'A' || *ptr > 'Z')
+  {
+    return TOKENIZER_ERROR;
+  }
+
+  // Most keywords are ruled out by their first letter without a call
   for (kt = keywords; kt->keyword != NULL; ++kt)
   {
-    if (strncmp(ptr, kt->keyword, strlen(kt->keyword)) == 0)
+    if (kt->keyword[0] == *ptr && strncmp(ptr + 1, kt->keyword + 1, kt->len - 1) == 0)
     {
-      nextptr = ptr + strlen(kt->keyword);
+      nextptr = ptr + kt->len;
       return kt->token;
     }
   }
 
-  if (*ptr >= 'A' && *ptr <= 'Z')
+  if (ptr[1] == '$')
   {
-    nextptr = ptr + 1;
-    return TOKENIZER_VARIABLE;
+    nextptr = ptr + 2;
+    return TOKENIZER_STRINGVAR;
   }
 
-  return TOKENIZER_ERROR;
+  nextptr = ptr + 1;
+  return TOKENIZER_VARIABLE;
 }
 
 void tokenizer_goto(const char *program)
@@ -175,7 +273,6 @@ void tokenizer_goto(const char *program)
 void tokenizer_init(const char *program)
 {
   tokenizer_goto(program);
-  current_token = get_next_token();
 }
 
 int tokenizer_token(void)
@@ -220,30 +317,67 @@ VariableType_t tokenizer_num(void)
   return atoi(ptr);
 }
 
-int tokenizer_string(char *dest, int len)
+VariableType_t tokenizer_parse_number(char const **text)
 {
-  char *string_end;
-  int string_len;
+  char const *p = *text;
+  VariableType_t value = 0;
+  int negative = 0;
 
-  string_end = strchr(ptr + 1, '"');
+  while (*p == ' ')
+  {
+    ++p;
+  }
 
-  if (string_end == NULL)
+  if (*p == '-')
   {
-    return 0;
+    negative = 1;
+    ++p;
   }
 
-  string_len = string_end - ptr - 1;
+  while (isdigit(*p))
+  {
+    value = value * 10 + (*p++ - '0');
+  }
+
+  value = VARTYPE_FROM_INT(value);
 
-  if (len < string_len)
+#if UBASIC_FIXED_POINT
+  if (*p == '.')
   {
-    string_len = len;
+    uint32_t frac = 0;
+    uint32_t scale = 1;
+
+    // Four digits keep frac << 16 within 32 bits
+    for (++p; isdigit(*p); ++p)
+    {
+      if (scale < 10000)
+      {
+        frac = frac * 10 + (*p - '0');
+        scale *= 10;
+      }
+    }
+
+    value += ((frac << VARTYPE_FRAC_BITS) + scale / 2) / scale;
   }
+#endif
 
-  memcpy(dest, ptr + 1, string_len);
+  *text = p;
 
-  dest[string_len] = '\0';
+  return negative ? -value : value;
+}
 
-  return string_len;
+VariableType_t tokenizer_value(void)
+{
+  char const *p = ptr;
+  return tokenizer_parse_number(&p);
+}
+
+// The current string literal in place, its length was measured while lexing
+char const *tokenizer_literal(int *len)
+{
+  *len = literal_len;
+
+  return ptr + 1;
 }
 
 void tokenizer_error_print(void)
@@ -265,3 +399,31 @@ char const *tokenizer_pos(void)
 {
   return ptr;
 }
+
+// Keyword text of a token, NULL for tokens that are not keywords
+char const *tokenizer_keyword(int token)
+{
+  struct keyword_token const *kt;
+
+  for (kt = keywords; kt->keyword != NULL; ++kt)
+  {
+    if (kt->token == token)
+    {
+      return kt->keyword;
+    }
+  }
+
+  return NULL;
+}
+
+#if UBASIC_STATS
+// Tokens lexed since the last call
+uint32_t tokenizer_stats(void)
+{
+  uint32_t n = lexed;
+
+  lexed = 0;
+
+  return n;
+}
+#endif
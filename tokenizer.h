@@ -40,6 +40,7 @@ enum
   TOKENIZER_NUMBER,
   TOKENIZER_STRING,
   TOKENIZER_VARIABLE,
+  TOKENIZER_STRINGVAR,
   TOKENIZER_LET,
   TOKENIZER_PRINT,
   TOKENIZER_IF,
@@ -59,6 +60,35 @@ enum
   TOKENIZER_LIST,
   TOKENIZER_INPUT,
   TOKENIZER_FRE,
+  TOKENIZER_DEF,
+  TOKENIZER_COMPILE,
+  TOKENIZER_TRACE,
+  TOKENIZER_ON,
+  TOKENIZER_OFF,
+  TOKENIZER_TIME,
+  TOKENIZER_STATS,
+  TOKENIZER_MEM,
+  TOKENIZER_OUT,
+  TOKENIZER_CHECKPOINT,
+  TOKENIZER_RESUME,
+  TOKENIZER_FN,
+  TOKENIZER_NOT,
+  TOKENIZER_ABS,
+  TOKENIZER_MIN,
+  TOKENIZER_MAX,
+  TOKENIZER_LEFT,
+  TOKENIZER_RIGHT,
+  TOKENIZER_MID,
+  TOKENIZER_CHR,
+  TOKENIZER_LEN,
+  TOKENIZER_ASC,
+  TOKENIZER_CYCLES,
+  TOKENIZER_INSTRET,
+  TOKENIZER_IN,
+  TOKENIZER_TIMER,
+  TOKENIZER_PA,
+  TOKENIZER_PB,
+  TOKENIZER_PC,
   TOKENIZER_COMMA,
   TOKENIZER_SEMICOLON,
   TOKENIZER_PLUS,
@@ -68,11 +98,17 @@ enum
   TOKENIZER_ASTR,
   TOKENIZER_SLASH,
   TOKENIZER_MOD,
+  TOKENIZER_XOR,
+  TOKENIZER_SHL,
+  TOKENIZER_SHR,
   TOKENIZER_LEFTPAREN,
   TOKENIZER_RIGHTPAREN,
   TOKENIZER_LT,
   TOKENIZER_GT,
   TOKENIZER_EQ,
+  TOKENIZER_LE,
+  TOKENIZER_GE,
+  TOKENIZER_NE,
   TOKENIZER_CR,
 };
 
@@ -81,12 +117,19 @@ void tokenizer_init(const char *program);
 void tokenizer_next(void);
 int tokenizer_token(void);
 VariableType_t tokenizer_num(void);
+VariableType_t tokenizer_value(void);
+VariableType_t tokenizer_parse_number(char const **text);
 VariableType_t tokenizer_variable_num(void);
-int tokenizer_string(char *dest, int len);
+char const *tokenizer_literal(int *len);
 
 int tokenizer_finished(void);
 void tokenizer_error_print(void);
 
 char const *tokenizer_pos(void);
+char const *tokenizer_keyword(int token);
+
+#if UBASIC_STATS
+uint32_t tokenizer_stats(void);
+#endif
 
 #endif /* __TOKENIZER_H__ */
@@ -35,21 +35,33 @@
 #include <string.h>
 #include <ctype.h>
 
+#if defined(__riscv)
 VariableType_t peek(VariableType_t addr);
 void poke(VariableType_t addr, VariableType_t val);
 
-static char input_buff[UBASIC_PROGRAM_LINE_WIDTH];
-static int char_count;
-
 extern char _text_end;
 #define FORBIDDEN_MEM_AREA (uintptr_t)(&_text_end)
+#else
+// Host builds run against the simulated memory, see host/repl.c
+#include "sim.h"
+#define peek sim_peek
+#define poke sim_poke
+#endif
+
+static char input_buff[UBASIC_PROGRAM_LINE_WIDTH];
+static int char_count;
 
 void ubasic_init(void)
 {
   interperter_init(peek, poke);
   memset(input_buff, 0, sizeof(input_buff));
   char_count = 0;
-  dma_nwrite(UBASIC_STARTUP_MESSAGE, sizeof(UBASIC_STARTUP_MESSAGE));
+  dma_nwrite(UBASIC_STARTUP_MESSAGE, sizeof(UBASIC_STARTUP_MESSAGE) - 1);
+
+  // The program area is only known once the interperter has carved it
+  sprintf(input_buff, "%u uBASIC BYTES FREE\nREADY.\n", (unsigned)interperter_bytes_free());
+  dma_write(input_buff);
+  memset(input_buff, 0, sizeof(input_buff));
 }
 
 void ubasic_run(void)
@@ -96,6 +108,7 @@ void ubasic_run(void)
   }
 }
 
+#if defined(__riscv)
 VariableType_t peek(VariableType_t addr)
 {
   return *(volatile VariableType_t *)(addr);
@@ -109,4 +122,5 @@ void poke(VariableType_t addr, VariableType_t val)
   }
 
   *(volatile VariableType_t *)(addr) = val;
-}
\ No newline at end of file
+}
+#endif
@@ -31,16 +31,30 @@
 #ifndef UBASIC_CFG_H
 #define UBASIC_CFG_H
 
-#include "vartype.h"
-
 #define UBASIC_MAX_STRINGLEN          40    // Maximum number of character per string variable
 #define UBASIC_MAX_NUMLEN             6     // Maximum number of digits for integer variables
 #define UBASIC_MAX_GOSUB_STACK_DEPTH  10    // Maximum number of subroutine/function calls
 #define UBASIC_MAX_FOR_STACK_DEPTH    4     // Maximum number of nested for
-#define UBASIC_FREE_BYTES             2560  // uBASIC program memory size
+#define UBASIC_HOST_HEAP_SIZE         8192  // Program memory of host builds, the target uses the RAM between .bss and the stack
 #define UBASIC_PROGRAM_LINE_WIDTH     40    // Maximum number of character per program line
+#define UBASIC_MAX_FN_PARAMS          3     // Maximum number of parameters per DEF FN function
+#define UBASIC_STRING_ARENA_SIZE      512   // Storage shared by all string variables
+#define UBASIC_LIST_CHUNK_SIZE        128   // LIST packs lines into two buffers of this size for DMA (min line width)
+#define UBASIC_DMA_ASYNC              0     // 1: DMA runs alongside the interpreter, needs the PCI_DMA_BUSY input in util/iom.h
+#define UBASIC_NATIVE_CODE_SIZE       2048  // Code buffer for COMPILE and hot lines in bytes
+#define UBASIC_SUPERINSTRUCTIONS      1     // 1: fused handlers for common statement shapes
+#define UBASIC_TRACE_SIZE             32    // Entries in the TRACE ring buffer, 0 removes tracing
+#define UBASIC_STATS                  1     // 1: statement and I/O counters for the STATS command
+#define UBASIC_INPUT_TICK             100   // TVR counts per INPUT timeout unit, 1 ms each in host/sim (max 255)
+#define UBASIC_JIT_THRESHOLD          16    // Executions before RUN compiles a line to native code (max 255)
+#ifndef UBASIC_FIXED_POINT // make host-check also builds with -DUBASIC_FIXED_POINT=1
+#define UBASIC_FIXED_POINT            0     // 1: Q16.16 fixed-point numbers, 0: plain integers
+#endif
+#define UBASIC_FIXED_POINT_DIGITS     4     // Number of fractional digits printed in fixed-point mode (max 4)
+#define UBASIC_PRINTF_INTEGER_ONLY    1     // 1: printf without float, exponential and long long support
+#define UBASIC_CHECKPOINT_SIZE        4096  // Bytes kept across resets for CHECKPOINT and RESUME, 0 removes them
 
 // PLEASE DO NOT EDIT!
-#define UBASIC_MAX_PROGRAM_LINES (UBASIC_FREE_BYTES / UBASIC_PROGRAM_LINE_WIDTH)
+#define UBASIC_MAX_PROGRAM_LINES (UBASIC_HOST_HEAP_SIZE / UBASIC_PROGRAM_LINE_WIDTH) // Upper bound for host tools
 
 #endif
@@ -9,7 +9,6 @@
 #define STR(s) #s
 #define STRINGIFY(s) STR(s)
 
-#define UBASIC_STARTUP_MESSAGE "VEECOM uBASIC "UBASIC_VERSION"\n"\
-STRINGIFY(UBASIC_FREE_BYTES)" uBASIC BYTES FREE\nREADY.\n"
+#define UBASIC_STARTUP_MESSAGE "VEECOM uBASIC "UBASIC_VERSION"\n"
 
 #endif
\ No newline at end of file
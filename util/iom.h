@@ -19,4 +19,11 @@
 #define TCR *(volatile uint8_t*)(0xffff) // Timer Control        (W)
 #define TXP *(volatile uint8_t*)(0xffff) // Timer Expired Flag   (R)
 
+// Bus address of a register above
+#define IO_ADDR(reg) ((uint16_t)(uintptr_t)&(reg))
+
+// Not part of the Veecom I/O map, a board that drives port C input bit 1
+// high while a DMA transfer is in progress can set UBASIC_DMA_ASYNC
+#define PCI_DMA_BUSY 0x02
+
 #endif
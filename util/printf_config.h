@@ -0,0 +1,16 @@
+// Build profile for printf.c, enabled by -DPRINTF_INCLUDE_CONFIG_H
+
+#ifndef PRINTF_CONFIG_H
+#define PRINTF_CONFIG_H
+
+#include "../ubasic_config.h"
+
+// uBASIC only formats ints, drop the float, exponential and 64-bit paths
+#if UBASIC_PRINTF_INTEGER_ONLY
+#define PRINTF_DISABLE_SUPPORT_FLOAT
+#define PRINTF_DISABLE_SUPPORT_EXPONENTIAL
+#define PRINTF_DISABLE_SUPPORT_LONG_LONG
+#define PRINTF_DISABLE_SUPPORT_PTRDIFF_T
+#endif
+
+#endif
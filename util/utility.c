@@ -1,16 +1,42 @@
 #include "utility.h"
 #include "printf.h"
+#include "../ubasic_config.h"
 
 #include <string.h>
 
+struct io_stats io_stats;
+
+#if UBASIC_DMA_ASYNC
+#define DMA_BUFFER_SIZE 64
+
+static char dma_buffers[2][DMA_BUFFER_SIZE];
+static int dma_next;
+#endif
+
 void _putchar(char character)
 {
+   io_stats.chars++;
+   // Queued text goes out first
+   dma_wait();
     PAO = character | 0x80;
     PAO = 0x00;
 }
 
-void dma_nwrite(char *str, uint16_t len)
+// Without UBASIC_DMA_ASYNC the CPU is held until a transfer is done, so
+// there is never anything to wait for
+
+void dma_wait(void)
 {
+#if UBASIC_DMA_ASYNC
+   while (PCI & PCI_DMA_BUSY)
+      ;
+#endif
+}
+
+void dma_start(char const *str, uint16_t len)
+{
+   io_stats.dma_bytes += len;
+   dma_wait();
    PCO |= 0x2;
    DSL = (uint8_t)(len & 0xff);
    DSH = (uint8_t)((len >> 8) & 0xff);
@@ -19,20 +45,43 @@ void dma_nwrite(char *str, uint16_t len)
    PCO &= ~(0x2);
 }
 
+// The two buffers alternate, a buffer's previous transfer has finished by
+// the time the transfer after it was started
+
+void dma_nwrite(char *str, uint16_t len)
+{
+#if UBASIC_DMA_ASYNC
+   while (len > 0)
+   {
+      uint16_t n = len < DMA_BUFFER_SIZE ? len : DMA_BUFFER_SIZE;
+      char *buf = dma_buffers[dma_next];
+
+      dma_next ^= 1;
+      memcpy(buf, str, n);
+      dma_start(buf, n);
+
+      str += n;
+      len -= n;
+   }
+#else
+   dma_start(str, len);
+#endif
+}
+
 void dma_write(char *str)
 {
    dma_nwrite(str, strlen(str));
 }
 
-// Blocking key read
+// Non-blocking key read, returns 0 when no key is pending
 
-char read_key(void)
+char poll_key(void)
 {
-   char k = 0;
+   char k = PBI;
 
-   while ((k & 0x80) == 0)
+   if ((k & 0x80) == 0)
    {
-      k = PBI;
+      return 0;
    }
 
    PCO |= 0x01;
@@ -40,3 +89,130 @@ char read_key(void)
 
    return k & 0x7f;
 }
+
+// Blocking key read
+
+char read_key(void)
+{
+   char k;
+
+   while ((k = poll_key()) == 0)
+      ;
+
+   return k;
+}
+
+// Line editor for INPUT, gives up after timeout expirations of a
+// UBASIC_INPUT_TICK timer (0 waits forever).
+// Returns the line length without the newline or -1 on timeout
+
+int read_line(char *buf, int len, int timeout)
+{
+   int count = 0;
+
+   if (timeout > 0)
+   {
+      TVR = UBASIC_INPUT_TICK;
+      TCR = 0x01;
+   }
+
+   for (;;)
+   {
+      char key = poll_key();
+
+      if (key == 0)
+      {
+         if (timeout > 0 && (TXP & 0x01))
+         {
+            if (--timeout == 0)
+            {
+               put_char('\n');
+               return -1;
+            }
+
+            TCR = 0x01;
+         }
+         continue;
+      }
+
+      put_char(key);
+
+      if (key == 10)
+      {
+         break;
+      }
+
+      if (key == 8)
+      {
+         if (count > 0)
+         {
+            count--;
+         }
+      }
+      else if (key != 12 && count < len - 1)
+      {
+         buf[count++] = key;
+      }
+   }
+
+   buf[count] = '\0';
+
+   return count;
+}
+
+// Low 32 bits of the cycle and retired instruction counters
+
+uint32_t read_cycles(void)
+{
+   uint32_t c;
+
+   __asm__ volatile("rdcycle %0" : "=r"(c));
+
+   return c;
+}
+
+uint32_t read_instret(void)
+{
+   uint32_t n;
+
+   __asm__ volatile("rdinstret %0" : "=r"(n));
+
+   return n;
+}
+
+// Section boundaries from linker.ld, .text starts at address 0
+
+extern char _text_end, _bss_start, _bss_end, _stack_limit, _sp;
+extern char _heap_start, _heap_end;
+
+void mem_map(struct mem_map *map)
+{
+   map->text = (uintptr_t)&_text_end;
+   map->data = &_bss_start - &_text_end;
+   map->bss = &_bss_end - &_bss_start;
+   map->stack = &_sp - &_stack_limit;
+   map->heap = &_heap_end - &_heap_start;
+}
+
+void *mem_heap(uint32_t *size)
+{
+   *size = &_heap_end - &_heap_start;
+
+   return &_heap_start;
+}
+
+#if UBASIC_CHECKPOINT_SIZE
+static uint32_t noinit[UBASIC_CHECKPOINT_SIZE / sizeof(uint32_t)] __attribute__((section(".noinit")));
+
+void *mem_noinit(uint32_t *size)
+{
+   *size = sizeof(noinit);
+
+   return noinit;
+}
+
+// Plain RAM, stores are done once they retire
+void mem_noinit_sync(void)
+{
+}
+#endif
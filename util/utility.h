@@ -6,9 +6,45 @@
 
 #define put_char _putchar
 
+// Output counters for the STATS command
+struct io_stats
+{
+    uint32_t dma_bytes;
+    uint32_t chars;
+};
+
+extern struct io_stats io_stats;
+
+// dma_write and dma_nwrite copy the text so the caller may reuse its buffer
+// at once, dma_start sends it in place and returns while it drains
 void dma_write(char *str);
 void dma_nwrite(char *str, uint16_t len);
+void dma_start(char const *str, uint16_t len);
+void dma_wait(void);
 
 char read_key(void);
+char poll_key(void);
+int read_line(char *buf, int len, int timeout);
+
+uint32_t read_cycles(void);
+uint32_t read_instret(void);
+
+// RAM layout in bytes, the heap is the gap between the end of .bss and the stack
+struct mem_map
+{
+    uint32_t text;
+    uint32_t data;
+    uint32_t bss;
+    uint32_t stack;
+    uint32_t heap;
+};
+
+void mem_map(struct mem_map *map);
+void *mem_heap(uint32_t *size);
+
+// Memory left alone by resets, the host keeps it in the file given with -c.
+// mem_noinit_sync makes the last writes to it stick
+void *mem_noinit(uint32_t *size);
+void mem_noinit_sync(void);
 
 #endif
@@ -32,6 +32,36 @@
 #ifndef __VARTYPE_H__
 #define __VARTYPE_H__
 
+#include <stdint.h>
+#include "ubasic_config.h"
+
 typedef int VariableType_t;
 
+#if UBASIC_FIXED_POINT
+#define VARTYPE_FRAC_BITS 16
+#define VARTYPE_MAX_STRLEN (8 + UBASIC_FIXED_POINT_DIGITS)
+
+// 64-bit intermediates keep the full Q16.16 precision, mulh covers the multiply
+#define VARTYPE_MUL(a, b) ((VariableType_t)(((int64_t)(a) * (b)) >> VARTYPE_FRAC_BITS))
+#define VARTYPE_DIV(a, b) ((VariableType_t)(((int64_t)(a) * (1 << VARTYPE_FRAC_BITS)) / (b)))
+#else
+#define VARTYPE_FRAC_BITS 0
+#define VARTYPE_MAX_STRLEN 12
+
+#define VARTYPE_MUL(a, b) ((a) * (b))
+#define VARTYPE_DIV(a, b) ((a) / (b))
+#endif
+
+// Shifted as unsigned, whole numbers past the Q16.16 range wrap instead of overflowing
+#define VARTYPE_FROM_INT(i) ((VariableType_t)((uint32_t)(i) << VARTYPE_FRAC_BITS))
+#define VARTYPE_TO_INT(v) ((VariableType_t)(v) >> VARTYPE_FRAC_BITS)
+
+#if UBASIC_FIXED_POINT
+// Q16.16 stops at 32767, addresses are taken modulo 64K so the upper half
+// of the map, the I/O registers included, is still reachable
+#define VARTYPE_TO_ADDR(v) (VARTYPE_TO_INT(v) & 0xffff)
+#else
+#define VARTYPE_TO_ADDR(v) VARTYPE_TO_INT(v)
+#endif
+
 #endif /* __VARTYPE_H__ */